@@ -0,0 +1,174 @@
+// src/bench/fanout_bench.cpp
+//
+// Fan-out throughput of ShardedBroadcaster: N loopback TCP clients, one
+// publisher pushing pre-encoded batches, K sender threads. Reports
+// delivered messages/s (summed over clients) for each K so scaling with
+// cores is visible.
+//
+//   fanout_bench --clients 200 --threads 1,2,4,8 --batches 20000
+#include "exchange_simulator.h"
+#include "wire.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+namespace {
+
+struct Options {
+    size_t clients = 100;
+    std::vector<size_t> threads{1, 2, 4};
+    size_t batches = 20000;
+    size_t symbols = 100;
+    size_t readers = 2;
+};
+
+std::vector<size_t> parse_list(const std::string& s) {
+    std::vector<size_t> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        out.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    return out;
+}
+
+// Connect `n` loopback clients; returns {client fds, server-side fds}
+bool make_connections(size_t n, std::vector<int>& client_fds,
+                      std::vector<int>& server_fds) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(lfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 4096) < 0) {
+        close(lfd);
+        return false;
+    }
+    socklen_t alen = sizeof(addr);
+    getsockname(lfd, (sockaddr*)&addr, &alen);
+
+    for (size_t i = 0; i < n; ++i) {
+        int c = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(c, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(c);
+            close(lfd);
+            return false;
+        }
+        int s = accept(lfd, nullptr, nullptr);
+        client_fds.push_back(c);
+        server_fds.push_back(s);
+    }
+    close(lfd);
+    return true;
+}
+
+// Drain a subset of client sockets until each has received `expect` bytes
+void reader(const std::vector<int>& fds, uint64_t expect) {
+    int ep = epoll_create1(0);
+    std::vector<uint64_t> got(fds.size(), 0);
+    for (size_t i = 0; i < fds.size(); ++i) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+
+    std::vector<char> buf(1 << 20);
+    size_t done = 0;
+    epoll_event events[64];
+    while (done < fds.size()) {
+        int n = epoll_wait(ep, events, 64, 1000);
+        if (n <= 0) break;   // sender stalled or client was dropped
+        for (int e = 0; e < n; ++e) {
+            size_t i = events[e].data.u64;
+            ssize_t r = recv(fds[i], buf.data(), buf.size(), MSG_DONTWAIT);
+            if (r <= 0) continue;
+            got[i] += r;
+            if (got[i] >= expect) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, fds[i], nullptr);
+                ++done;
+            }
+        }
+    }
+    close(ep);
+}
+
+void run_once(const Options& opt, size_t threads, const FrameBatch& batch) {
+    std::vector<int> client_fds, server_fds;
+    if (!make_connections(opt.clients, client_fds, server_fds)) {
+        std::cerr << "[bench] Failed to set up " << opt.clients
+                  << " connections (check ulimit -n)\n";
+        return;
+    }
+
+    ShardedBroadcaster fanout(threads, opt.symbols, batch.size(),
+                              SlowConsumerPolicy::Buffer, 64 << 20);
+    for (int fd : server_fds) fanout.add_client(fd);
+
+    const uint64_t expect = uint64_t(batch.size()) * opt.batches;
+    std::vector<std::thread> readers;
+    for (size_t r = 0; r < opt.readers; ++r) {
+        std::vector<int> mine;
+        for (size_t i = r; i < client_fds.size(); i += opt.readers)
+            mine.push_back(client_fds[i]);
+        readers.emplace_back(reader, mine, expect);
+    }
+
+    // Let shards adopt their sockets before the clock starts
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < opt.batches; ++b)
+        fanout.publish(batch.data(), batch.size());
+    for (auto& t : readers) t.join();
+    auto t1 = std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    double msgs = double(batch.msgs()) * opt.batches * opt.clients;
+
+    std::cout << "threads=" << threads
+              << " clients=" << opt.clients
+              << " elapsed=" << secs << "s"
+              << " fanout=" << uint64_t(msgs / secs) << " msgs/s"
+              << " (" << (msgs * batch.size() / batch.msgs() / secs) / (1 << 20)
+              << " MB/s)\n";
+
+    for (int fd : client_fds) close(fd);
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--clients")      opt.clients = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--threads") opt.threads = parse_list(argv[i + 1]);
+        else if (arg == "--batches") opt.batches = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--symbols") opt.symbols = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--readers") opt.readers = std::max<size_t>(1, std::strtoul(argv[i + 1], nullptr, 10));
+    }
+
+    // One sweep worth of real frames, re-published every iteration
+    TickGenerator gen(opt.symbols);
+    std::vector<Tick> sweep(opt.symbols);
+    FrameBatch batch(opt.symbols);
+    gen.generate_all(sweep.data(), 0);
+    for (const Tick& tick : sweep)
+        batch.commit(wire::encode(tick, batch.tail()));
+
+    std::cout << "[bench] " << batch.msgs() << " msgs/batch, "
+              << batch.size() << " bytes/batch, "
+              << std::thread::hardware_concurrency() << " cores\n";
+
+    for (size_t k : opt.threads)
+        run_once(opt, k, batch);
+    return 0;
+}
@@ -0,0 +1,400 @@
+// src/bench/feed_replay.cpp
+//
+// Replays a byte stream through the feed handler's receive path without a
+// socket: each chunk is copied into a MirroredByteRing (as recv() would),
+// parsed in place and applied to LockFreeSymbolCache / DepthCache, with the
+// same per-tick stamps and LatencyTracker records as FeedHandler::process.
+// The stream is either a capture (feed_handler --capture) or frames made
+// up front by TickGenerator. Chunks keep their captured sizes or are cut to
+// --chunk N / --chunk LO-HI bytes to imitate TCP fragmentation. Timing is
+// as fast as possible, or the captured (or --rate) pacing. Each capture
+// line gets its own ring and parser, resumed where the capture marks a
+// reconnect; with several lines the first copy of each seq wins, as in
+// FeedHandler's arbiter.
+//
+//   feed_replay --capture /tmp/session.cap --line 0 --timing original
+//   feed_replay --capture /tmp/session.cap --line -1   # every line, arbitrated
+//   feed_replay --msgs 2000000 --symbols 500 --chunk 1-1448 --rounds 5
+//   feed_replay --msgs 2000000 --min-mps 5000000   # exit 1 if slower
+#include "header.h"
+#include "exchange_simulator.h"
+#include "capture_journal.h"
+#include "ring_buffer.h"
+#include "tsc_clock.h"
+#include "wire.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+struct Options {
+    std::string capture;          // empty = synthetic stream
+    int line = 0;                 // capture line to replay (-1 = all)
+    size_t symbols = 500;         // cache size; capture ids beyond are dropped
+    size_t msgs = 1000000;
+    size_t depth = 0;             // synthetic L2 levels per side
+    uint64_t rate = 100000;       // synthetic msgs/s for original timing
+    uint64_t seed = 42;
+    size_t chunk_lo = 0;          // 0 = as captured (synthetic: 4096)
+    size_t chunk_hi = 0;
+    bool original_timing = false;
+    size_t rounds = 1;
+    double min_mps = 0;           // regression gate, 0 = off
+};
+
+// Contiguous bytes with the time they were received (or generated)
+struct Span {
+    const uint8_t* data;
+    size_t len;
+    uint64_t rx_ns;
+    uint16_t line;
+    bool connect;   // first bytes of a new connection on the line
+};
+
+// TickGenerator frames, round-robin over symbols, spaced 1/rate apart
+std::vector<uint8_t> make_stream(const Options& opt, std::vector<Span>& spans) {
+    TickGenerator gen(opt.symbols, opt.seed);
+    gen.set_depth_levels(opt.depth);
+    std::vector<uint8_t> stream(opt.msgs * wire::MAX_FRAME_SIZE);
+    std::vector<std::pair<size_t, uint64_t>> frames;   // offset, ts
+    frames.reserve(opt.msgs);
+    size_t len = 0;
+
+    for (size_t i = 0; i < opt.msgs; ++i) {
+        uint16_t sym = static_cast<uint16_t>(i % opt.symbols);
+        if (sym == 0) gen.step();
+        uint64_t ts = i * 1000000000ull / std::max<uint64_t>(opt.rate, 1);
+        Tick tick;
+        gen.emit(sym, ts, tick);
+        frames.emplace_back(len, ts);
+        len += wire::encode(tick, stream.data() + len);
+    }
+    stream.resize(len);
+
+    spans.reserve(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i) {
+        size_t end = i + 1 < frames.size() ? frames[i + 1].first : len;
+        spans.push_back(Span{stream.data() + frames[i].first,
+                             end - frames[i].first, frames[i].second, 0, false});
+    }
+    return stream;
+}
+
+// Spin out the last stretch; sleeping is too coarse below ~100 us
+void wait_until(std::chrono::steady_clock::time_point t) {
+    for (;;) {
+        auto left = t - std::chrono::steady_clock::now();
+        if (left <= std::chrono::nanoseconds(0)) return;
+        if (left > std::chrono::microseconds(200))
+            std::this_thread::sleep_for(left - std::chrono::microseconds(100));
+        else
+            TscClock::cpu_relax();
+    }
+}
+
+struct RoundResult {
+    uint64_t msgs = 0;
+    uint64_t bytes = 0;
+    uint64_t chunks = 0;
+    uint64_t duplicates = 0;   // copies the arbiter dropped
+    double seconds = 0;
+    ParserStats parser;        // summed over lines
+};
+
+// One line's receive side, as FeedHandler's FeedLine has it
+struct ReplayLine {
+    static constexpr size_t RX_BUF_SIZE = 64 * 1024;
+    explicit ReplayLine(size_t num_symbols)
+        : rx_buffer(ring.valid() ? 0 : RX_BUF_SIZE), parser(num_symbols) {}
+
+    MirroredByteRing ring{RX_BUF_SIZE};
+    std::vector<uint8_t> rx_buffer;
+    MarketDataParser parser;
+};
+
+// One pass over `spans`, chunked per the options
+RoundResult replay(const Options& opt, const std::vector<Span>& spans,
+                   LockFreeSymbolCache& cache, DepthCache* depth,
+                   LatencyHistogram& rx_to_cache) {
+    std::vector<std::unique_ptr<ReplayLine>> lines;
+    size_t num_lines = 0;
+    for (const Span& s : spans) {
+        if (s.line >= lines.size()) lines.resize(s.line + 1);
+        if (!lines[s.line]) {
+            lines[s.line] = std::make_unique<ReplayLine>(cache.size());
+            ++num_lines;
+        }
+    }
+    const bool arbitrate = num_lines > 1;
+
+    // The arbiter's state: highest applied seq per symbol, and its line
+    struct Applied {
+        uint64_t seq{0};
+        uint16_t line{0};
+    };
+    std::vector<Applied> applied(arbitrate ? cache.size() : 0);
+    uint16_t cur = 0;   // line of the chunk being parsed
+
+    LatencyTracker& latency = LatencyTracker::instance();
+    CacheUpdater update{cache, depth};
+    std::vector<Tick> snapshot;
+
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_int_distribution<size_t> chunk_len(opt.chunk_lo, opt.chunk_hi);
+
+    RoundResult r;
+    StageTimestamps stamps;
+
+    // As in FeedHandler::process: snapshot bursts go to the cache in one
+    // batch, everything else is stamped, applied and recorded per tick
+    auto apply_snapshot = [&] {
+        cache.applyBatch(snapshot.data(), snapshot.size());
+        snapshot.clear();
+    };
+    auto on_tick = [&](const Tick& tick) {
+        ++r.msgs;
+        if (arbitrate) {
+            Applied& a = applied[tick.symbol_id];
+            if (tick.type == MsgType::DepthImage) {
+                // Shares its Snapshot's seq: goes with the copy that won
+                if (tick.seq_no != a.seq || a.line != cur) return;
+            } else if (tick.seq_no <= a.seq) {
+                ++r.duplicates;
+                return;
+            } else {
+                // A seq no line delivered: the merged stream lost a delta
+                if (tick.type != MsgType::Snapshot && a.seq != 0 &&
+                    tick.seq_no != a.seq + 1 && depth)
+                    depth->invalidate(tick.symbol_id, tick.timestamp_ns);
+                a.seq = tick.seq_no;
+                a.line = cur;
+            }
+        }
+        if (tick.type == MsgType::Snapshot) {
+            snapshot.push_back(tick);
+            if (depth) depth->clear(tick.symbol_id, tick.timestamp_ns);
+            return;
+        }
+        if (tick.type == MsgType::DepthImage) {
+            if (depth) depth->apply(tick);
+            return;
+        }
+        if (!snapshot.empty()) apply_snapshot();
+
+        stamps.parsed_ns = wall_clock_ns();
+
+        update(tick);
+
+        stamps.published_ns = wall_clock_ns();
+        latency.record(stamps);
+        rx_to_cache.record(stamps.published_ns - stamps.user_rx_ns);
+    };
+
+    size_t span = 0, span_off = 0;
+    const uint64_t first_ns = spans.empty() ? 0 : spans[0].rx_ns;
+    auto t0 = std::chrono::steady_clock::now();
+
+    while (span < spans.size()) {
+        cur = spans[span].line;
+        ReplayLine& line = *lines[cur];
+        MirroredByteRing& ring = line.ring;
+        if (span_off == 0 && spans[span].connect) {
+            // As FeedHandler on a reconnect: drop the old connection's
+            // partial frame and resume from the last seqs
+            ring.clear();
+            line.parser.resume_session();
+        }
+
+        // "recv": up to one chunk, never more than the ring has room for
+        uint8_t* dst = ring.valid() ? ring.write_ptr() : line.rx_buffer.data();
+        size_t room = ring.valid() ? ring.free_space() : line.rx_buffer.size();
+        size_t want = opt.chunk_hi ? std::min(chunk_len(rng), room)
+                                   : std::min(spans[span].len - span_off, room);
+
+        if (opt.original_timing && spans[span].rx_ns > first_ns)
+            wait_until(t0 + std::chrono::nanoseconds(spans[span].rx_ns - first_ns));
+
+        size_t got = 0;
+        while (got < want && span < spans.size()) {
+            size_t n = std::min(want - got, spans[span].len - span_off);
+            std::memcpy(dst + got, spans[span].data + span_off, n);
+            got += n;
+            span_off += n;
+            if (span_off == spans[span].len) {
+                ++span;
+                span_off = 0;
+                // A chunk never spans two lines or two connections
+                if (span < spans.size() &&
+                    (spans[span].line != cur || spans[span].connect)) break;
+            }
+        }
+
+        // Stream and exchange clocks are not ours: stamps start at "recv"
+        stamps.user_rx_ns = wall_clock_ns();
+
+        if (ring.valid()) {
+            ring.commit(got);
+            ring.consume(line.parser.parse(ring.read_ptr(), ring.size(), on_tick));
+        } else {
+            line.parser.consume(line.rx_buffer.data(), got, on_tick);
+        }
+        if (!snapshot.empty()) apply_snapshot();
+
+        r.bytes += got;
+        ++r.chunks;
+    }
+
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for (const auto& line : lines) {
+        if (!line) continue;
+        const ParserStats& st = line->parser.stats();
+        r.parser.frames += st.frames;
+        r.parser.resyncs += st.resyncs;
+        r.parser.bytes_skipped += st.bytes_skipped;
+        r.parser.seq_gaps += st.seq_gaps;
+        r.parser.stale += st.stale;
+    }
+    return r;
+}
+
+bool parse_chunk(const std::string& spec, Options& opt) {
+    size_t dash = spec.find('-');
+    opt.chunk_lo = std::strtoul(spec.c_str(), nullptr, 10);
+    opt.chunk_hi = dash == std::string::npos
+        ? opt.chunk_lo : std::strtoul(spec.c_str() + dash + 1, nullptr, 10);
+    if (opt.chunk_hi == 0) return true;   // as captured
+    return opt.chunk_lo > 0 && opt.chunk_lo <= opt.chunk_hi;
+}
+
+void print_percentiles(const char* name, const LatencyHistogram::Snapshot& snap) {
+    static const double pcts[] = {50, 90, 99, 99.9, 99.99};
+    char line[160];
+    int n = std::snprintf(line, sizeof(line), "%-18s %10llu", name,
+                          (unsigned long long)snap.total);
+    for (double p : pcts)
+        n += std::snprintf(line + n, sizeof(line) - n, " %8.2f",
+                           snap.percentile(p) / 1000.0);
+    std::snprintf(line + n, sizeof(line) - n, " %8.2f\n", snap.max() / 1000.0);
+    std::cout << line;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--capture")       opt.capture = argv[i + 1];
+        else if (arg == "--line")     opt.line = std::atoi(argv[i + 1]);
+        else if (arg == "--symbols")  opt.symbols = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--msgs")     opt.msgs = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--depth")    opt.depth = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--rate")     opt.rate = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--seed")     opt.seed = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (arg == "--timing")   opt.original_timing = std::string(argv[i + 1]) == "original";
+        else if (arg == "--rounds")   opt.rounds = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--min-mps")  opt.min_mps = std::strtod(argv[i + 1], nullptr);
+        else if (arg == "--chunk") {
+            if (!parse_chunk(argv[i + 1], opt)) {
+                std::cerr << "[replay] Bad --chunk " << argv[i + 1] << "\n";
+                return 2;
+            }
+        }
+        else std::cerr << "[replay] Ignoring unknown option " << arg << "\n";
+    }
+    opt.symbols = std::min<size_t>(std::max<size_t>(opt.symbols, 1), 65536);
+    opt.msgs = std::max<size_t>(opt.msgs, 1);
+    opt.rounds = std::max<size_t>(opt.rounds, 1);
+
+    // Source: captured chunks of one line, or a generated stream
+    std::unique_ptr<CaptureReader> capture;
+    std::vector<uint8_t> stream;
+    std::vector<Span> spans;
+
+    if (!opt.capture.empty()) {
+        capture = std::make_unique<CaptureReader>(opt.capture);
+        if (!capture->valid()) {
+            std::cerr << "[replay] No capture at " << opt.capture << "\n";
+            return 2;
+        }
+        for (const CaptureReader::Chunk& c : capture->chunks()) {
+            if (opt.line < 0 || c.line == opt.line)
+                spans.push_back(Span{c.data, c.len, c.rx_ns, c.line,
+                                     (c.flags & capture::RECORD_CONNECT) != 0});
+        }
+        std::cout << "[replay] Capture " << opt.capture << ": "
+                  << capture->segments() << " segments, " << spans.size()
+                  << " chunks";
+        if (opt.line >= 0) std::cout << " on line " << opt.line;
+        std::cout << "\n";
+    } else {
+        stream = make_stream(opt, spans);
+        if (opt.chunk_hi == 0) opt.chunk_lo = opt.chunk_hi = 4096;
+        std::cout << "[replay] Generated " << opt.msgs << " msgs, "
+                  << stream.size() << " bytes, " << opt.symbols << " symbols\n";
+    }
+    if (spans.empty()) {
+        std::cerr << "[replay] Nothing to replay\n";
+        return 2;
+    }
+
+    // Same shape as feed_handler's defaults: --symbols ids, 10 L2 levels
+    LockFreeSymbolCache cache(opt.symbols);
+    DepthCache depth(opt.symbols, 10);
+    LatencyHistogram rx_to_cache;
+
+    std::cout << "[replay] " << (opt.original_timing ? "original timing" : "max speed")
+              << ", chunks ";
+    if (opt.chunk_hi == 0) std::cout << "as captured";
+    else if (opt.chunk_lo == opt.chunk_hi) std::cout << opt.chunk_lo << " B";
+    else std::cout << opt.chunk_lo << "-" << opt.chunk_hi << " B";
+    std::cout << ", " << opt.rounds << " round(s)\n";
+
+    double best_mps = 0;
+    for (size_t round = 0; round < opt.rounds; ++round) {
+        RoundResult r = replay(opt, spans, cache, &depth, rx_to_cache);
+        double mps = r.seconds > 0 ? r.msgs / r.seconds : 0;
+        best_mps = std::max(best_mps, mps);
+
+        char line[200];
+        std::snprintf(line, sizeof(line),
+                      "round %zu: %llu msgs, %llu chunks, %.3f s, %.0f msgs/s, "
+                      "%.1f ns/msg, %.1f MB/s\n",
+                      round + 1, (unsigned long long)r.msgs,
+                      (unsigned long long)r.chunks, r.seconds, mps,
+                      r.msgs ? r.seconds * 1e9 / r.msgs : 0.0,
+                      r.bytes / r.seconds / 1e6);
+        std::cout << line;
+        if (round == 0)
+            std::cout << "  parser: frames=" << r.parser.frames
+                      << " resyncs=" << r.parser.resyncs
+                      << " skipped=" << r.parser.bytes_skipped << "B"
+                      << " gaps=" << r.parser.seq_gaps
+                      << " stale=" << r.parser.stale
+                      << " duplicates=" << r.duplicates << "\n";
+    }
+
+    char header[160];
+    std::snprintf(header, sizeof(header), "%-18s %10s %8s %8s %8s %8s %8s %8s\n",
+                  "Latency (us)", "samples", "p50", "p90", "p99", "p99.9",
+                  "p99.99", "max");
+    std::cout << header;
+    print_percentiles("parse", LatencyTracker::instance().snapshot(LatencyStage::Parse));
+    print_percentiles("cache publish", LatencyTracker::instance().snapshot(LatencyStage::Publish));
+    print_percentiles("rx->cache", rx_to_cache.snapshot());
+
+    if (opt.min_mps > 0 && best_mps < opt.min_mps) {
+        std::cerr << "[replay] Below --min-mps: " << best_mps << " < "
+                  << opt.min_mps << " msgs/s\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+// src/bench/tickgen_bench.cpp
+//
+// Single-core throughput of TickGenerator (+ wire encoding):
+//
+//   tickgen_bench --symbols 10000 --seconds 2
+#include "exchange_simulator.h"
+#include "wire.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+int main(int argc, char* argv[]) {
+    size_t symbols = 10000;
+    double seconds = 2.0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--symbols")      symbols = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--seconds") seconds = std::strtod(argv[i + 1], nullptr);
+    }
+    symbols = std::min<size_t>(std::max<size_t>(symbols, 1), 65536);
+
+    TickGenerator gen(symbols);
+    std::vector<Tick> sweep(symbols);
+    std::vector<uint8_t> out(symbols * wire::MAX_FRAME_SIZE);
+
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now() + std::chrono::duration<double>(seconds);
+    auto t0 = clock::now();
+
+    uint64_t ticks = 0, bytes = 0, sweeps = 0;
+    while (clock::now() < deadline) {
+        size_t n = gen.generate_all(sweep.data(), sweeps);
+        size_t len = 0;
+        for (size_t i = 0; i < n; ++i)
+            len += wire::encode(sweep[i], out.data() + len);
+        ticks += n;
+        bytes += len;
+        ++sweeps;
+    }
+
+    double secs = std::chrono::duration<double>(clock::now() - t0).count();
+    std::cout << "symbols=" << symbols
+              << " sweeps=" << sweeps
+              << " ticks/s=" << uint64_t(ticks / secs)
+              << " ns/tick=" << secs * 1e9 / ticks
+              << " MB/s=" << bytes / secs / (1 << 20) << "\n";
+    return 0;
+}
@@ -6,213 +6,677 @@
 #include <iostream>
 #include <vector>
 #include <cstring>
+#include <pthread.h>
+#include <sched.h>
 #include "header.h"
+#include "tsc_clock.h"      // cpu_relax()
+#include "ring_buffer.h"    // MirroredByteRing
 #include "protocol.h"        // Tick, SymbolCache
+#include "capture_journal.h"
 // socket.cpp and parser.cpp expose their classes internally
 
 // Forward declarations (no headers by design)
 // class MarketDataSocket;
 // class Parser;
 
+// Low-latency receive path (all off by default)
+struct ReceiveOptions {
+    bool spin{false};          // busy-poll recvmsg instead of epoll_wait
+    int cpu{-1};               // pin the receive thread (-1 = don't)
+    int busy_poll_us{0};       // SO_BUSY_POLL budget (0 = off)
+    bool prefer_busy_poll{false};
+};
+
+// Pin the calling thread to one CPU
+static bool pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+/* ---------------- FeedHandler ----------------
+ * Receives one or more copies ("lines") of the same feed, e.g. an A and a
+ * B line from two servers. Each line has its own socket, receive ring and
+ * parser, so framing, per-line seq checks and gap replay work exactly as
+ * with a single connection. With two or more lines, ticks then go through
+ * an arbiter: the first copy of each (symbol, seq) is applied and later
+ * copies are dropped, so one line fills the other's gaps. A line that
+ * gaps holds that symbol's later ticks while its replay is pending
+ * (--recovery-ms), which is what gives the other line time to fill in.
+ *
+ * The arbiter is one load, compare and store of the symbol's highest
+ * applied seq. The rx time of the winning copy sits next to it, so a
+ * duplicate can record how far its line lags. A server restart resets
+ * seqs to 1, which the arbiter would treat as duplicates; with several
+ * lines, restart the client as well.
+ */
 class FeedHandler {
 public:
    FeedHandler(const std::string& host,
                 uint16_t port,
                 LockFreeSymbolCache& cache);
 
+    // Another copy of the same feed; call before run()
+    void add_line(const std::string& host, uint16_t port);
+
     void run();
 
+    // Symbols to request from the server on every (re)connect; empty = all
+    void set_subscription(std::vector<uint16_t> symbols);
+
+    void set_receive_options(const ReceiveOptions& opts);
+
+    // Where DepthUpdate messages go; null = top of book only
+    void set_depth_cache(DepthCache* depth) { depth_ = depth; }
+
+    // Ask the server to replay seq gaps, holding the symbol's later ticks
+    // for up to `timeout` (0 = just count gaps and carry on)
+    void set_gap_recovery(std::chrono::milliseconds timeout);
+
+    // Arbitration stats, one entry per line
+    std::vector<const LineStats*> line_stats() const;
+
+    // Record every received chunk to <path>.NNNNNN segments; call before run()
+    bool set_capture(const std::string& path, size_t segment_bytes);
+
 private:
-    bool connect_with_retry();
-    void setup_epoll();
+    static constexpr size_t RX_BUF_SIZE = 64 * 1024;
+    static constexpr int MAX_RETRIES = 5;
+    static constexpr std::chrono::seconds CONNECT_TIMEOUT{5};
+
+    struct FeedLine {
+        FeedLine(uint16_t i, const std::string& h, uint16_t p, size_t num_symbols)
+            : index(i), host(h), port(p), parser(num_symbols) {
+            stats.name = h + ":" + std::to_string(p);
+        }
+
+        uint16_t index;
+        std::string host;
+        uint16_t port;
+        MarketDataSocket socket;
+
+        // Receive straight into a mirrored ring and parse in place; rx_buffer
+        // (copy + staged partial frames) only if the ring can't be mapped
+        MirroredByteRing ring{RX_BUF_SIZE};
+        std::vector<uint8_t> rx_buffer;
+
+        MarketDataParser parser;
+        LineStats stats;
+        bool fresh{false};   // no chunk captured since the connect
+
+        // Reconnect schedule while the line is down
+        bool up{false};
+        bool connecting{false};   // attempt in flight, see finish_connect()
+        std::chrono::steady_clock::time_point connect_deadline;
+        int retries{0};
+        int backoff_ms{100};
+        std::chrono::steady_clock::time_point down_since;
+        std::chrono::steady_clock::time_point retry_at;
+    };
+
+    bool connect_line(size_t index);
+    bool finish_connect(size_t index);
+    void line_down(FeedLine& line);
+    void retry_lines();
+    void watch(size_t index, bool connecting);
+    void configure_socket(MarketDataSocket& socket);
+    void run_epoll();
+    void run_spin();
+    ssize_t receive(FeedLine& line);
+    bool on_receive(size_t index, ssize_t bytes);
+    void process(FeedLine& line, size_t bytes);
+    void apply_snapshot();
+    void print_stats(const FeedLine& line) const;
     void shutdown();
 
 private:
-    std::string host_;
-    uint16_t port_;
-
     LockFreeSymbolCache& cache_; 
+    DepthCache* depth_{nullptr};
+    std::vector<uint16_t> subscription_;
+    ReceiveOptions rx_opts_;
+    std::chrono::milliseconds recovery_timeout_{0};
+    std::unique_ptr<CaptureJournal> capture_;
+
+    std::vector<std::unique_ptr<FeedLine>> lines_;
+    size_t lines_down_{0};
+
+    // Arbiter state per symbol: highest seq applied, across all lines
+    struct Applied {
+        uint32_t seq{0};
+        uint16_t line{0};    // which line delivered it
+        uint64_t rx_ns{0};   // when the winning copy was received
+    };
+    std::vector<Applied> applied_;
 
     int epoll_fd_;
     bool running_;
 
-    MarketDataSocket socket_;
-    MarketDataParser parser_;
+    // Snapshot frames of the current burst, applied to the cache together
+    std::vector<Tick> snapshot_;
+    uint64_t snapshot_symbols_{0};
 };
 
 FeedHandler::FeedHandler(const std::string& host,
                          uint16_t port,
                          LockFreeSymbolCache& cache)
-    : host_(host),
-      port_(port),
-      cache_(cache),
+    : cache_(cache),
+      applied_(cache.size()),
       epoll_fd_(-1),
-      running_(true),
-      parser_(cache.size()) {} 
+      running_(true) {
+    add_line(host, port);
+}
 
-bool FeedHandler::connect_with_retry() {
-    constexpr int MAX_RETRIES = 5;
-    int backoff_ms = 100;
+void FeedHandler::add_line(const std::string& host, uint16_t port) {
+    lines_.push_back(std::make_unique<FeedLine>(uint16_t(lines_.size()), host, port,
+                                                cache_.size()));
+}
 
-    for (int attempt = 0; attempt < MAX_RETRIES && running_; ++attempt) {
-        std::cout << "[feed] Connecting to "
-                  << host_ << ":" << port_ << "\n";
+bool FeedHandler::set_capture(const std::string& path, size_t segment_bytes) {
+    capture_ = std::make_unique<CaptureJournal>(path, segment_bytes);
+    if (!capture_->valid()) capture_.reset();
+    return capture_ != nullptr;
+}
 
-        if (socket_.connect(host_, port_)) {
-            socket_.set_tcp_nodelay(true);
-            socket_.set_recv_buffer_size(4 * 1024 * 1024);
-            return true;
-        }
+std::vector<const LineStats*> FeedHandler::line_stats() const {
+    std::vector<const LineStats*> out;
+    for (const auto& line : lines_) out.push_back(&line->stats);
+    return out;
+}
+
+void FeedHandler::set_subscription(std::vector<uint16_t> symbols) {
+    subscription_ = std::move(symbols);
+}
+
+void FeedHandler::set_receive_options(const ReceiveOptions& opts) {
+    rx_opts_ = opts;
+}
+
+void FeedHandler::set_gap_recovery(std::chrono::milliseconds timeout) {
+    recovery_timeout_ = timeout;
+}
 
-        std::cout << "[feed] Connect failed, retrying in "
-                  << backoff_ms << " ms\n";
+void FeedHandler::configure_socket(MarketDataSocket& socket) {
+    socket.set_tcp_nodelay(true);
+    socket.set_recv_buffer_size(4 * 1024 * 1024);
 
-        std::this_thread::sleep_for(
-            std::chrono::milliseconds(backoff_ms));
+    if (rx_opts_.busy_poll_us > 0 &&
+        !socket.set_busy_poll(rx_opts_.busy_poll_us, rx_opts_.prefer_busy_poll)) {
+        std::cerr << "[feed] SO_BUSY_POLL not applied (needs CAP_NET_ADMIN "
+                     "above net.core.busy_read, or kernel support)\n";
+    }
+}
+
+// Start one connection attempt without waiting for it, so the other lines
+// keep flowing; false if it failed outright. finish_connect() completes it.
+bool FeedHandler::connect_line(size_t index) {
+    FeedLine& line = *lines_[index];
+    std::cout << "[feed] Connecting to " << line.stats.name << "\n";
+    if (!line.socket.start_connect(line.host, line.port)) return false;
+
+    line.connecting = true;
+    line.connect_deadline = std::chrono::steady_clock::now() + CONNECT_TIMEOUT;
+    watch(index, true);
+    return true;
+}
 
-        backoff_ms *= 2; // exponential backoff
+// Called when a connecting line's socket turns writable, and on every
+// retry pass. Returns true once the line is up; a failed or timed-out
+// attempt goes through line_down() like any other.
+bool FeedHandler::finish_connect(size_t index) {
+    FeedLine& line = *lines_[index];
+    if (!line.connecting) return line.up;
+
+    auto now = std::chrono::steady_clock::now();
+    int state = line.socket.poll_connect();
+    if (state == 0 && now < line.connect_deadline) return false;
+
+    line.connecting = false;
+    if (state != 1) {
+        if (epoll_fd_ >= 0)
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, line.socket.socket_fd(), nullptr);
+        line.socket.disconnect();
+        line_down(line);
+        return false;
     }
 
-    return false;
+    configure_socket(line.socket);
+    if (!subscription_.empty() &&
+        !line.socket.send_subscription(subscription_)) {
+        std::cerr << "[feed] Failed to send subscription\n";
+    }
+    // Pick up where the last connection left off (no-op the first time);
+    // the capture marks the spot so a replay can do the same
+    line.parser.resume_session();
+    line.fresh = true;
+
+    line.up = true;
+    line.retries = 0;
+    line.backoff_ms = 100;
+    --lines_down_;
+    watch(index, false);
+    if (line.down_since != std::chrono::steady_clock::time_point{}) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+            now - line.down_since).count();
+        std::cout << "[feed] Reconnected in " << us << " us\n";
+        print_stats(line);
+    }
+    return true;
 }
 
-void FeedHandler::setup_epoll() {
-    epoll_fd_ = epoll_create1(0);
+// Called after the server closed or reset the connection, or a connect
+// attempt failed. The other lines keep running while this one backs off.
+void FeedHandler::line_down(FeedLine& line) {
+    auto now = std::chrono::steady_clock::now();
+    if (line.up) {
+        if (epoll_fd_ >= 0)
+            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, line.socket.socket_fd(), nullptr);
+        line.socket.disconnect();
+        line.ring.clear();
+        line.up = false;
+        line.down_since = now;
+        line.retry_at = now;   // first retry straight away
+        ++lines_down_;
+        return;
+    }
+
+    if (++line.retries >= MAX_RETRIES) {
+        std::cerr << "[feed] Giving up on " << line.stats.name << "\n";
+        line.retry_at = std::chrono::steady_clock::time_point::max();
+        --lines_down_;   // nothing left to retry: no more fast polling for it
+        bool any_left = false;
+        for (const auto& l : lines_)
+            any_left |= l->up || l->retries < MAX_RETRIES;
+        if (!any_left) running_ = false;
+        return;
+    }
+    std::cout << "[feed] Connect failed, retrying in "
+              << line.backoff_ms << " ms\n";
+    line.retry_at = now + std::chrono::milliseconds(line.backoff_ms);
+    line.backoff_ms *= 2; // exponential backoff
+}
 
+// Start attempts that are due and check the ones in flight (their
+// deadline, and completion in spin mode, which has no epoll to report it)
+void FeedHandler::retry_lines() {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lines_.size(); ++i) {
+        FeedLine& line = *lines_[i];
+        if (line.up) continue;
+        if (line.connecting) {
+            finish_connect(i);
+            continue;
+        }
+        if (now < line.retry_at) continue;
+        if (!connect_line(i)) line_down(line);
+    }
+}
+
+void FeedHandler::print_stats(const FeedLine& line) const {
+    const ParserStats& st = line.parser.stats();
+    std::cout << "[feed] ";
+    if (lines_.size() > 1) std::cout << line.stats.name << " ";
+    std::cout << "frames=" << st.frames
+              << " bad_checksums=" << st.bad_checksums
+              << " bad_types=" << st.bad_types
+              << " resyncs=" << st.resyncs
+              << " skipped=" << st.bytes_skipped << "B"
+              << " max_resync=" << st.max_resync_bytes << "B";
+    if (st.resyncs)
+        std::cout << " avg_resync=" << st.resync_ns / st.resyncs << "ns";
+    std::cout << " gaps=" << st.seq_gaps
+              << " stale=" << st.stale
+              << " snapshot=" << snapshot_symbols_;
+    if (st.recoveries) {
+        std::cout << " recovered=" << st.recovered << "/" << st.recoveries
+                  << " timeouts=" << st.recovery_timeouts
+                  << " unrecovered=" << st.unrecovered;
+        if (st.recovered)
+            std::cout << " avg_recovery=" << st.recovery_ns / st.recovered / 1000
+                      << "us max=" << st.max_recovery_ns / 1000 << "us";
+    }
+    if (lines_.size() > 1)
+        std::cout << " wins=" << line.stats.wins.load(std::memory_order_relaxed)
+                  << " duplicates=" << line.stats.duplicates.load(std::memory_order_relaxed);
+    std::cout << "\n";
+}
+
+// Edge-triggered, tagged with the line index. A connecting socket is
+// added with EPOLLOUT, which fires when the attempt ends; once up it is
+// switched to EPOLLIN alone.
+void FeedHandler::watch(size_t index, bool connecting) {
+    if (epoll_fd_ < 0) return;
     epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLET;
-    // ev.data.fd = socket_.fd(); // socket exposes fd()
-    ev.data.fd = socket_.socket_fd();
+    ev.events = EPOLLIN | EPOLLET | (connecting ? EPOLLOUT : 0);
+    ev.data.u32 = uint32_t(index);
+    epoll_ctl(epoll_fd_, connecting ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+              lines_[index]->socket.socket_fd(), &ev);
+}
 
-    // epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket_.fd(), &ev);
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, socket_.socket_fd(), &ev);
+ssize_t FeedHandler::receive(FeedLine& line) {
+    if (line.ring.valid())
+        return line.socket.receive(line.ring.write_ptr(), line.ring.free_space());
+    return line.socket.receive(line.rx_buffer.data(), line.rx_buffer.size());
+}
+
+void FeedHandler::process(FeedLine& line, size_t bytes) {
+    LatencyTracker& latency = LatencyTracker::instance();
+
+    StageTimestamps stamps;
+    stamps.kernel_rx_ns = line.socket.last_kernel_rx_ns();
+    stamps.user_rx_ns = line.socket.last_user_rx_ns();
+
+    // Record the chunk as received, before parsing consumes it
+    if (capture_) {
+        const uint8_t* chunk = line.ring.valid() ? line.ring.write_ptr()
+                                                 : line.rx_buffer.data();
+        capture_->append(line.index, stamps.user_rx_ns, stamps.kernel_rx_ns,
+                         chunk, bytes, line.fresh ? capture::RECORD_CONNECT : 0);
+        line.fresh = false;
+    }
+
+    CacheUpdater update{cache_, depth_};
+    const bool arbitrate = lines_.size() > 1;
+
+    // Concrete lambda type: parse<> inlines it (and the updater) per frame
+    auto on_tick = [&](const Tick& tick) {
+        if (arbitrate) {
+            bool image = tick.type == MsgType::DepthImage ||
+                         tick.type == MsgType::Snapshot;
+            // Per-line latency counts every copy, won or not
+            if (!image && stamps.user_rx_ns > tick.timestamp_ns)
+                line.stats.latency.record(stamps.user_rx_ns - tick.timestamp_ns);
+
+            Applied& applied = applied_[tick.symbol_id];
+            if (tick.type == MsgType::DepthImage) {
+                // Shares its Snapshot's seq: goes with the copy that won
+                if (tick.seq_no != applied.seq || applied.line != line.index) return;
+            } else if (tick.seq_no <= applied.seq) {
+                LineStats::bump(line.stats.duplicates);
+                if (tick.seq_no == applied.seq && stamps.user_rx_ns > applied.rx_ns)
+                    line.stats.lag.record(stamps.user_rx_ns - applied.rx_ns);
+                return;
+            } else {
+                // A seq no line delivered: the merged stream lost a delta
+                if (!image && applied.seq != 0 && tick.seq_no != applied.seq + 1 && depth_)
+                    depth_->invalidate(tick.symbol_id, tick.timestamp_ns);
+                applied.seq = tick.seq_no;
+                applied.line = line.index;
+                applied.rx_ns = stamps.user_rx_ns;
+                LineStats::bump(line.stats.wins);
+            }
+        }
+
+        // The connect-time burst is collected and applied in one pass; it
+        // carries last-update times, so it stays out of the latency stats.
+        // Each Snapshot's L2 image follows it and replaces the book.
+        if (tick.type == MsgType::Snapshot) {
+            snapshot_.push_back(tick);
+            if (depth_) depth_->clear(tick.symbol_id, tick.timestamp_ns);
+            return;
+        }
+        if (tick.type == MsgType::DepthImage) {
+            if (depth_) depth_->apply(tick);
+            return;
+        }
+        if (!snapshot_.empty()) apply_snapshot();
+
+        stamps.exchange_ns = tick.timestamp_ns;
+        stamps.parsed_ns = wall_clock_ns();
+
+        update(tick);
+
+        stamps.published_ns = wall_clock_ns();
+        latency.record(stamps);
+    };
+
+    if (line.ring.valid()) {
+        // Parse in place; a partial frame just stays in the ring
+        line.ring.commit(bytes);
+        line.ring.consume(line.parser.parse(line.ring.read_ptr(), line.ring.size(), on_tick));
+    } else {
+        line.parser.consume(line.rx_buffer.data(), bytes, on_tick);
+    }
+    if (!snapshot_.empty()) apply_snapshot();
+}
+
+void FeedHandler::apply_snapshot() {
+    cache_.applyBatch(snapshot_.data(), snapshot_.size());
+    snapshot_symbols_ += snapshot_.size();
+    snapshot_.clear();
+}
+
+// Handles one receive() result; returns false once the socket is drained
+bool FeedHandler::on_receive(size_t index, ssize_t bytes) {
+    FeedLine& line = *lines_[index];
+    if (bytes > 0) {
+        process(line, bytes);
+        return true;
+    }
+    if (bytes == 0 || !line.socket.is_connected()) {
+        // FIN, or an error such as ECONNRESET
+        std::cout << "[feed] Server " << line.stats.name << " "
+                  << (bytes == 0 ? "closed" : "reset")
+                  << " connection\n";
+        line_down(line);
+        retry_lines();
+    }
+    return false;   // EAGAIN / EWOULDBLOCK, or a fresh connection
 }
 
 void FeedHandler::run() {
-    if (!connect_with_retry()) {
-        std::cerr << "[feed] Unable to connect, exiting\n";
-        return;
+    if (rx_opts_.cpu >= 0) {
+        if (pin_to_cpu(rx_opts_.cpu))
+            std::cout << "[feed] Receive thread pinned to CPU " << rx_opts_.cpu << "\n";
+        else
+            std::cerr << "[feed] Failed to pin to CPU " << rx_opts_.cpu << "\n";
+    }
+
+    for (auto& l : lines_) {
+        FeedLine& line = *l;
+        if (!line.ring.valid()) {
+            std::cerr << "[feed] Mirrored ring unavailable, parsing from a copy\n";
+            line.rx_buffer.resize(RX_BUF_SIZE);
+        }
+        if (recovery_timeout_.count() <= 0) continue;
+        line.parser.set_gap_recovery(
+            [&line](uint16_t symbol, uint32_t from, uint32_t to) {
+                if (!line.socket.send_retransmit_request(symbol, from, to))
+                    std::cerr << "[feed] Failed to request replay of sym=" << symbol << "\n";
+            },
+            recovery_timeout_);
+    }
+    // One line: its holes are the book's. Several: the arbiter watches the
+    // merged stream instead, since another line may fill them.
+    if (depth_ && lines_.size() == 1) {
+        lines_[0]->parser.set_gap_lost([this](uint16_t symbol) {
+            depth_->invalidate(symbol, wall_clock_ns());
+        });
     }
+    if (lines_.size() > 1)
+        std::cout << "[feed] Arbitrating " << lines_.size() << " lines\n";
 
-    setup_epoll();
+    // Every line starts out down and due for its first attempt
+    lines_down_ = lines_.size();
+    if (!rx_opts_.spin) epoll_fd_ = epoll_create1(0);
+    retry_lines();
 
-    constexpr size_t RX_BUF_SIZE = 64 * 1024;
-    std::vector<char> rx_buffer(RX_BUF_SIZE);
+    if (rx_opts_.spin)
+        run_spin();
+    else
+        run_epoll();
 
+    shutdown();
+}
+
+void FeedHandler::run_epoll() {
     epoll_event events[8];
 
     while (running_) {
-        int n = epoll_wait(epoll_fd_, events, 8, 1000);
+        // Wake up for the next reconnect attempt or connect deadline while
+        // a line is down (lines that were given up on don't count)
+        int timeout_ms = lines_down_ ? 10 : 1000;
+        int n = epoll_wait(epoll_fd_, events, 8, timeout_ms);
+        if (lines_down_) retry_lines();
 
         if (n < 0)
             continue;
 
         for (int i = 0; i < n; ++i) {
-            if (!(events[i].events & EPOLLIN))
+            size_t index = events[i].data.u32;
+            if (lines_[index]->connecting) {
+                // The attempt has ended; data may already be queued
+                if (!finish_connect(index)) continue;
+            } else if (!(events[i].events & EPOLLIN) || !lines_[index]->up) {
                 continue;
+            }
 
             // Read until EAGAIN (edge-triggered requirement)
-            while (true) {
-                ssize_t bytes =
-                    socket_.receive(rx_buffer.data(), rx_buffer.size());
-
-                if (bytes > 0) {
-
-                    parser_.consume(reinterpret_cast<const uint8_t*>(rx_buffer.data()),bytes, [&](const Tick& tick) {
-
-                    if (tick.type == MsgType::Trade) {
-                        cache_.updateTrade(
-                            tick.symbol_id,
-                            tick.last_trade_price,
-                            tick.trade_qty,
-                            tick.timestamp_ns
-                        );
-                    }
-                    else if (tick.type == MsgType::Quote) {
-                        cache_.updateBid(
-                            tick.symbol_id,
-                            tick.bid_price,
-                            tick.bid_qty,
-                            tick.timestamp_ns
-                        );
-                        cache_.updateAsk(
-                            tick.symbol_id,
-                            tick.ask_price,
-                            tick.ask_qty,
-                            tick.timestamp_ns
-                        );
-                    }
-                 });
-
-                    // parser_.consume(reinterpret_cast<const uint8_t*>(rx_buffer.data()),bytes,[&](const Tick& tick) {
-                    //     // Trade update
-                    //     if (tick.trade_qty > 0) {
-                    //         cache_.updateTrade(tick.symbol_id,tick.last_trade_price,tick.trade_qty,tick.timestamp_ns);
-                    //     }
-
-                    //     // Quote update
-                    //     cache_.updateBid(tick.symbol_id,tick.bid_price,tick.bid_qty,tick.timestamp_ns);
-                    //     cache_.updateAsk(tick.symbol_id,tick.ask_price,tick.ask_qty,tick.timestamp_ns);
-
-                    //     });
-
-                    // Feed raw bytes to parser
-                    // parser_.consume(rx_buffer.data(), bytes,[&](const Tick& tick) {
-                    //     // Trade update
-                    //     if (tick.trade_qty > 0) {
-                    //         cache_.updateTrade(tick.symbol_id,tick.last_trade_price,tick.trade_qty,tick.timestamp_ns);
-                    //     }
-
-                    //     // Quote update
-                    //     cache_.updateBid(tick.symbol_id,tick.bid_price,tick.bid_qty,tick.timestamp_ns);
-                    //     cache_.updateAsk(tick.symbol_id,tick.ask_price,tick.ask_qty,tick.timestamp_ns);
-                    //     });
-                    
-                }
-                else if (bytes == 0) {
-                    std::cout << "[feed] Server closed connection\n";
-                    socket_.disconnect();
-                    // epoll_ctl(epoll_fd_, EPOLL_CTL_DEL,socket_.fd(), nullptr); socket_.socket_fd()
-
-                    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL,socket_.socket_fd(), nullptr);
-
-                    if (!connect_with_retry())
-                        running_ = false;
-                    else
-                        setup_epoll();
-                    break;
-                }
-                else { // EAGAIN / EWOULDBLOCK
-                    break;
-                }
-            }
+            while (on_receive(index, receive(*lines_[index]))) {}
         }
     }
+}
 
-    shutdown();
+// No epoll and no sleeping: poll every line in a tight loop so a message
+// is picked up as soon as the kernel (or busy poll) has it queued.
+void FeedHandler::run_spin() {
+    while (running_) {
+        bool idle = true;
+        for (size_t i = 0; i < lines_.size(); ++i) {
+            if (lines_[i]->up && on_receive(i, receive(*lines_[i])))
+                idle = false;
+        }
+        if (lines_down_) retry_lines();
+        if (idle)
+            TscClock::cpu_relax();
+    }
 }
 
 void FeedHandler::shutdown() {
+    bool connected = false;
+    for (const auto& line : lines_) {
+        connected |= line->up || line->down_since != std::chrono::steady_clock::time_point{};
+        print_stats(*line);
+        line->socket.disconnect();
+    }
+    if (!connected)
+        std::cerr << "[feed] Unable to connect, exiting\n";
+    if (capture_)
+        std::cout << "[feed] Captured " << capture_->chunks() << " chunks, "
+                  << capture_->bytes() << " bytes in " << capture_->segments()
+                  << " segments, dropped " << capture_->dropped() << "\n";
     if (epoll_fd_ >= 0)
         close(epoll_fd_);
-    socket_.disconnect();
 }
 
 
 
 
 
-int main() {
+// "0-9,42,100-199" -> symbol ids
+static std::vector<uint16_t> parse_symbol_list(const std::string& spec) {
+    std::vector<uint16_t> out;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(pos, end - pos);
+
+        size_t dash = item.find('-');
+        unsigned long lo = std::strtoul(item.c_str(), nullptr, 10);
+        unsigned long hi = dash == std::string::npos
+            ? lo : std::strtoul(item.c_str() + dash + 1, nullptr, 10);
+        for (unsigned long id = lo; id <= hi && id <= 0xFFFF; ++id)
+            out.push_back(static_cast<uint16_t>(id));
+
+        pos = end + 1;
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
     constexpr size_t NUM_SYMBOLS = 500;
 
-    // Shared lock-free cache
-    LockFreeSymbolCache cache(NUM_SYMBOLS);
+    std::string host = "127.0.0.1";
+    uint16_t port = 9876;
+    std::vector<uint16_t> subscription;
+    ReceiveOptions rx;
+    std::string shm_name;
+    size_t depth_levels = 10;
+    long recovery_ms = 100;
+    std::string capture_path;
+    size_t capture_mb = 256;
+    std::vector<std::pair<std::string, uint16_t>> extra_lines;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--host")           host = argv[i + 1];
+        else if (arg == "--port")      port = static_cast<uint16_t>(std::atoi(argv[i + 1]));
+        else if (arg == "--subscribe") subscription = parse_symbol_list(argv[i + 1]);
+        else if (arg == "--rx-mode")   rx.spin = std::string(argv[i + 1]) == "spin";
+        else if (arg == "--cpu")       rx.cpu = std::atoi(argv[i + 1]);
+        else if (arg == "--busy-poll-us") {
+            rx.busy_poll_us = std::atoi(argv[i + 1]);
+            rx.prefer_busy_poll = rx.busy_poll_us > 0;
+        }
+        else if (arg == "--depth")     depth_levels = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--recovery-ms") recovery_ms = std::atol(argv[i + 1]);
+        else if (arg == "--capture")    capture_path = argv[i + 1];
+        else if (arg == "--capture-mb") capture_mb = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--line") {
+            // Another copy of the feed, host:port (or just port on --host)
+            std::string spec = argv[i + 1];
+            size_t colon = spec.rfind(':');
+            std::string line_host = colon == std::string::npos ? host : spec.substr(0, colon);
+            int line_port = std::atoi(spec.c_str() + (colon == std::string::npos ? 0 : colon + 1));
+            if (line_port > 0 && line_port <= 0xFFFF)
+                extra_lines.emplace_back(line_host, static_cast<uint16_t>(line_port));
+            else
+                std::cerr << "[feed] Ignoring bad --line " << spec << "\n";
+        }
+        else if (arg == "--shm") {
+            shm_name = argv[i + 1];
+            if (shm_name[0] != '/') shm_name.insert(0, "/");
+        }
+        else std::cerr << "[feed] Ignoring unknown option " << arg << "\n";
+    }
+
+    // Shared lock-free cache, optionally exported for other processes
+    LockFreeSymbolCache cache(NUM_SYMBOLS,
+                              shm_name.empty() ? nullptr : shm_name.c_str());
+    if (!shm_name.empty()) {
+        if (cache.shared())
+            std::cout << "[feed] Cache exported as shm " << shm_name << "\n";
+        else
+            std::cerr << "[feed] Could not export cache as shm " << shm_name
+                      << ", using process memory\n";
+    }
+
+    // L2 book, fed by DepthUpdate messages (server --depth)
+    std::unique_ptr<DepthCache> depth;
+    if (depth_levels > 0)
+        depth = std::make_unique<DepthCache>(NUM_SYMBOLS, depth_levels);
 
     // Feed handler (writer)
-    FeedHandler handler("127.0.0.1", 9876, cache);
+    FeedHandler handler(host, port, cache);
+    for (const auto& line : extra_lines)
+        handler.add_line(line.first, line.second);
+    handler.set_subscription(subscription);
+    handler.set_receive_options(rx);
+    handler.set_depth_cache(depth.get());
+    handler.set_gap_recovery(std::chrono::milliseconds(recovery_ms));
+    if (!capture_path.empty()) {
+        if (handler.set_capture(capture_path, capture_mb << 20))
+            std::cout << "[feed] Capturing to " << capture_path << ".NNNNNN ("
+                      << capture_mb << " MiB segments)\n";
+        else
+            std::cerr << "[feed] Could not create capture " << capture_path << "\n";
+    }
 
     // Visualizer (reader)
     Visualizer vis(cache, NUM_SYMBOLS);
+    vis.set_depth_cache(depth.get());
+    vis.set_line_stats(handler.line_stats());
 
     // UI thread
     std::thread ui([&] {
@@ -12,7 +12,10 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <cstring>
 #include "protocol.h" // for MemoryPool and LatencyTracker from common folder
+#include "wire.h"
+#include "depth_cache.h"
 
 class MarketDataSocket {
 public:
@@ -22,10 +25,20 @@ public:
     bool connect(const std::string& host, uint16_t port,
                  uint32_t timeout_ms = 5000);
 
+    // Non-blocking connect: start_connect() returns once the attempt is
+    // under way (false if it failed outright). The socket turns writable
+    // when it ends; poll_connect() then says 1 = connected, -1 = failed,
+    // and 0 while it is still in progress. Neither call blocks.
+    bool start_connect(const std::string& host, uint16_t port);
+    int poll_connect();
+
     ssize_t receive(void* buffer, size_t max_len);
 
     bool send_subscription(const std::vector<uint16_t>& symbol_ids);
 
+    // Ask for symbol_id's frames from..to again (wire::RETRANSMIT_REQUEST)
+    bool send_retransmit_request(uint16_t symbol_id, uint32_t from, uint32_t to);
+
     bool is_connected() const;
     void disconnect();
 
@@ -33,6 +46,19 @@ public:
     bool set_recv_buffer_size(size_t bytes);
     bool set_socket_priority(int priority);
 
+    // Kernel software receive timestamps on every recvmsg
+    // (SO_TIMESTAMPING, falling back to SO_TIMESTAMPNS)
+    bool enable_rx_timestamps();
+
+    // SO_BUSY_POLL: let recvmsg poll the device queue for up to `usec`
+    // before returning EAGAIN; `prefer` also sets SO_PREFER_BUSY_POLL
+    bool set_busy_poll(int usec, bool prefer);
+
+    // Stamps of the last successful receive() (wall_clock_ns(); kernel
+    // stamp is 0 if the kernel didn't supply one)
+    uint64_t last_kernel_rx_ns() const { return rx_kernel_ns_; }
+    uint64_t last_user_rx_ns() const { return rx_user_ns_; }
+
     int epoll_fd() const { return epoll_fd_; }
     int socket_fd() const { return sock_fd_; }
 
@@ -44,6 +70,8 @@ private:
     int sock_fd_{-1};
     int epoll_fd_{-1};
     bool connected_{false};
+    uint64_t rx_kernel_ns_{0};
+    uint64_t rx_user_ns_{0};
 
     MemoryPool recv_pool_{64 * 1024, 64};   // 64KB buffers
     // LatencyTracker latency_;
@@ -51,41 +79,424 @@ private:
 
 struct Tick;
 
+// Framing and sequencing counters, owned by the parsing thread
+struct ParserStats {
+    uint64_t frames{0};             // valid frames, heartbeats included
+    uint64_t bad_checksums{0};
+    uint64_t bad_types{0};
+    uint64_t resyncs{0};            // times framing was lost and regained
+    uint64_t bytes_skipped{0};      // discarded while resynchronising
+    uint64_t max_resync_bytes{0};
+    uint64_t resync_ns{0};          // total time spent out of sync
+    uint64_t max_resync_ns{0};
+    uint64_t seq_gaps{0};
+    uint64_t stale{0};              // seq <= last seen: dropped
+
+    // Gap recovery (set_gap_recovery)
+    uint64_t recoveries{0};         // holes a replay was requested for
+    uint64_t recovered{0};          // holes the replay filled
+    uint64_t recovery_timeouts{0};  // holes given up on
+    uint64_t unrecovered{0};        // seqs never replayed (server no longer had them)
+    uint64_t recovery_ns{0};        // total request -> hole filled
+    uint64_t max_recovery_ns{0};
+};
+
+// One copy of a redundant (A/B) feed, as seen by the arbiter. Written by
+// the feed thread, read by the visualizer.
+struct LineStats {
+    std::string name;                       // host:port
+    std::atomic<uint64_t> wins{0};          // ticks this line delivered first
+    std::atomic<uint64_t> duplicates{0};    // ticks another line delivered first
+    LatencyHistogram latency;               // exchange -> user rx, every tick
+    LatencyHistogram lag;                   // duplicates: rx behind the winning copy
+
+    // Single writer: plain load + store, no locked RMW
+    static void bump(std::atomic<uint64_t>& n) {
+        n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+// Applies parsed ticks to the cache. A concrete type (not std::function)
+// so MarketDataParser::parse<> inlines it into the decode loop.
+struct CacheUpdater {
+    LockFreeSymbolCache& cache;
+    DepthCache* depth = nullptr;   // L2 updates are dropped without one
+
+    void operator()(const Tick& tick) const {
+        if (tick.type == MsgType::Trade)      cache.applyTrade(tick);
+        else if (tick.type == MsgType::Quote) cache.applyQuote(tick);
+        else if (tick.type == MsgType::DepthUpdate && depth) depth->apply(tick);
+        else if (tick.type == MsgType::Snapshot) {
+            cache.applySnapshot(tick);
+            if (depth) depth->clear(tick.symbol_id, tick.timestamp_ns);   // image follows
+        }
+        else if (tick.type == MsgType::DepthImage && depth) depth->apply(tick);
+    }
+};
+
 class MarketDataParser {
 public:
     using TickCallback = std::function<void(const Tick&)>;
 
     explicit MarketDataParser(size_t num_symbols); //MarketDataParser();
 
-    // Consume raw TCP bytes
-    void consume(const uint8_t* data,
-                 size_t len,
-                 TickCallback on_tick);
+    // Handlers are any callable taking `const Tick&`. They are template
+    // parameters so the call is resolved statically and inlined; a
+    // TickCallback still works but costs an indirect call per message.
 
-private:
-    static constexpr size_t MAX_BUFFER = 1 << 20;
-    static constexpr size_t HEADER_SIZE = 16;
-    static constexpr size_t CHECKSUM_SIZE = 4;
+    // Consume raw TCP bytes from any buffer; a frame split across calls is
+    // staged internally, everything else is decoded in place
+    template <typename Handler>
+    void consume(const uint8_t* data, size_t len, Handler&& on_tick);
+
+    // Decode every complete frame in [data, data + len) in place and return
+    // the bytes consumed; the caller keeps the unconsumed tail (always
+    // shorter than wire::MAX_FRAME_SIZE) and passes it again with more data
+    template <typename Handler>
+    size_t parse(const uint8_t* data, size_t len, Handler&& on_tick);
+
+    // New connection: drop partial frames and per-symbol sequence state
+    void reset_session();
+
+    // Reconnected to the same feed: drop partial frames but keep per-symbol
+    // sequence state, so each symbol's first frame exposes the hole the
+    // outage left. Recoveries in flight are requested again.
+    void resume_session();
 
-    alignas(64) uint8_t buffer_[MAX_BUFFER];
-    size_t write_pos_;
-    size_t read_pos_;
+    // Gap recovery. `request(symbol, from, to)` is called for every hole;
+    // the symbol's later ticks are then held back until replayed frames
+    // fill it (applied as they come) or `timeout` passes, so the cache never
+    // sees a symbol's updates out of order. Timeouts are checked when data
+    // arrives. Without a request callback gaps are only counted.
+    using GapRequest = std::function<void(uint16_t, uint32_t, uint32_t)>;
+    void set_gap_recovery(GapRequest request, std::chrono::milliseconds timeout);
+
+    // Called for a symbol whose hole was passed over unfilled (no recovery,
+    // timed out, or older than the server still holds). Top of book heals
+    // with the next tick; an L2 book that missed a delta stays wrong until
+    // the next DepthImage.
+    using GapLost = std::function<void(uint16_t)>;
+    void set_gap_lost(GapLost lost) { gap_lost_ = std::move(lost); }
+
+    const ParserStats& stats() const { return stats_; }
+
+private:
+    // Straddling frame: < MAX_FRAME_SIZE held + up to MAX_FRAME_SIZE taken
+    uint8_t staging_[2 * wire::MAX_FRAME_SIZE];
+    size_t staged_;
     // uint32_t last_seq_;
     std::vector<uint32_t> last_seq_per_symbol_;
 
+    // Per-symbol sequencing state; anything but Live takes the slow path
+    enum SymbolState : uint8_t { Live, Recovering, Resumed };
+
+    struct Recovery {
+        uint32_t next;                // first seq still missing
+        uint32_t to;                  // last seq of the hole
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point deadline;
+        std::vector<Tick> held;       // live ticks past the hole
+    };
+    static constexpr size_t MAX_HELD = 4096;   // per symbol, then give up
+
+    std::vector<uint8_t> state_;
+    std::vector<Recovery> recovery_;
+    std::vector<uint16_t> recovering_;         // symbols in Recovering
+    GapRequest gap_request_;
+    GapLost gap_lost_;
+    std::chrono::milliseconds recovery_timeout_{0};
+
+    // DepthImage frames waiting for the Snapshot that follows them
+    std::vector<Tick> image_;
+    static constexpr size_t MAX_IMAGE = 2 * 256;   // both sides, u8 levels
+
+    ParserStats stats_;
+    bool in_sync_{true};
+    uint64_t resync_bytes_{0};
+    std::chrono::steady_clock::time_point resync_start_;
+
     void reset();
-    void parse_loop(TickCallback on_tick);
-    void drop_bytes(size_t n);
-    void compact();
+
+    // Out of line: only hit on damaged or unusual frames
+    size_t skip_bytes(size_t n);
+    void resynced();
+    bool seq_gap(uint16_t symbol_id, uint32_t expected, uint32_t got);
+    void unknown_symbol(uint16_t symbol_id);
+    void resumed(const wire::FrameHeader& h);
+    bool start_recovery(uint16_t symbol_id, uint32_t from, uint32_t to);
+    void hold(const wire::FrameHeader& h, const uint8_t* frame);
+    void depth_image(const wire::FrameHeader& h, const uint8_t* frame);
+    void lost(uint16_t symbol_id);
+
+    template <typename Handler>
+    void snapshot(const wire::FrameHeader& h, const uint8_t* frame, Handler& on_tick);
+    template <typename Handler>
+    void recover(const wire::FrameHeader& h, const uint8_t* frame, Handler& on_tick);
+    template <typename Handler>
+    void end_recovery(uint16_t symbol_id, bool filled, Handler& on_tick);
+    template <typename Handler>
+    void expire_recoveries(Handler& on_tick);
 };
 
+template <typename Handler>
+void MarketDataParser::consume(const uint8_t* data, size_t len,
+                               Handler&& on_tick) {
+    if (len == 0) return;
+
+    size_t off = 0;
+    if (staged_ > 0) {
+        // Complete the straddling frame: one more frame's worth is always
+        // enough, since staged_ < MAX_FRAME_SIZE
+        size_t take = std::min(len, wire::MAX_FRAME_SIZE);
+        std::memcpy(staging_ + staged_, data, take);
+        size_t held = staged_;
+        size_t used = parse(staging_, held + take, on_tick);
+
+        if (used < held) {
+            // Still incomplete: only possible when all of `data` was taken
+            std::memmove(staging_, staging_ + used, held + take - used);
+            staged_ = held + take - used;
+            return;
+        }
+        staged_ = 0;
+        off = used - held;   // continue in place from here
+    }
+
+    off += parse(data + off, len - off, on_tick);
+
+    // Keep the partial tail (< MAX_FRAME_SIZE bytes) for the next read
+    staged_ = len - off;
+    std::memcpy(staging_, data + off, staged_);
+}
+
+template <typename Handler>
+size_t MarketDataParser::parse(const uint8_t* data, size_t len,
+                               Handler&& on_tick) {
+    if (!recovering_.empty()) expire_recoveries(on_tick);
+
+    size_t pos = 0;
+    while (true) {
+        size_t available = len - pos;
+        if (available < wire::MIN_FRAME_SIZE)
+            break;
+
+        const uint8_t* ptr = data + pos;
+        wire::FrameHeader h = wire::read_header(ptr);
+
+        ptrdiff_t payload_size = wire::payload_size(h.type);
+        if (payload_size < 0) {
+            ++stats_.bad_types;
+            pos += skip_bytes(1 + wire::scan_for_frame(ptr + 1, available - 1));
+            continue;
+        }
+
+        size_t msg_size = wire::HEADER_SIZE + payload_size + wire::CHECKSUM_SIZE;
+        if (available < msg_size) break;
+
+        if (!wire::verify(ptr, msg_size)) {
+            ++stats_.bad_checksums;
+            pos += skip_bytes(1 + wire::scan_for_frame(ptr + 1, available - 1));
+            continue;
+        }
+
+        ++stats_.frames;
+        if (!in_sync_) resynced();
+
+        if (h.type == static_cast<uint16_t>(MsgType::Heartbeat)) {
+            pos += msg_size;
+            continue;
+        }
+
+        if (h.symbol_id >= last_seq_per_symbol_.size()) {
+            unknown_symbol(h.symbol_id);
+            pos += msg_size;
+            continue;
+        }
+
+        if (h.type == static_cast<uint16_t>(MsgType::Snapshot)) {
+            snapshot(h, ptr, on_tick);
+            pos += msg_size;
+            continue;
+        }
+        if (h.type == static_cast<uint16_t>(MsgType::DepthImage)) {
+            depth_image(h, ptr);
+            pos += msg_size;
+            continue;
+        }
+
+        // ===============================
+        // ✅ SEQUENCE GAP CHECK GOES HERE
+        // ===============================
+        auto& last = last_seq_per_symbol_[h.symbol_id];
+        if (state_[h.symbol_id] != Live) {
+            if (state_[h.symbol_id] == Recovering) {
+                recover(h, ptr, on_tick);
+                pos += msg_size;
+                continue;
+            }
+            resumed(h);
+        }
+        if (last != 0 && h.seq <= last) {
+            // Duplicate or overtaken by a newer update: applying it would
+            // roll the symbol back
+            ++stats_.stale;
+            pos += msg_size;
+            continue;
+        }
+        if (last != 0 && h.seq != last + 1 &&
+            seq_gap(h.symbol_id, last + 1, h.seq)) {
+            // Replay requested: this tick waits behind the hole
+            hold(h, ptr);
+            pos += msg_size;
+            continue;
+        }
+        last = h.seq;
+
+        Tick tick{};
+        wire::decode(h, ptr, tick);
+
+        on_tick(tick);
+        pos += msg_size;
+    }
+    return pos;
+}
+
+// A Snapshot is a whole top-of-book image as of its seq, not a delta: it
+// supersedes every earlier seq, so it never opens a gap. After a reconnect
+// it is the new baseline whatever its seq (a lower one means a restarted
+// feed); otherwise only an older image is stale. During a replay it covers
+// the hole up to its seq. The DepthImage frames held for it go out right
+// after it, before any held tick, so the handler can swap in the L2 book.
+template <typename Handler>
+void MarketDataParser::snapshot(const wire::FrameHeader& h, const uint8_t* frame,
+                                Handler& on_tick) {
+    auto& last = last_seq_per_symbol_[h.symbol_id];
+    uint8_t& state = state_[h.symbol_id];
+
+    if (state == Resumed) {
+        state = Live;
+    } else if (last != 0 && h.seq <= last) {
+        ++stats_.stale;
+        image_.clear();
+        return;
+    }
+
+    Tick tick{};
+    wire::decode(h, frame, tick);
+    on_tick(tick);
+    last = h.seq;
+
+    if (!image_.empty() && image_[0].symbol_id == h.symbol_id &&
+        image_[0].seq_no == h.seq) {
+        for (const Tick& level : image_) on_tick(level);
+    }
+    image_.clear();
+
+    if (state == Recovering) {
+        Recovery& r = recovery_[h.symbol_id];
+        r.next = h.seq + 1;
+        if (h.seq >= r.to) end_recovery(h.symbol_id, true, on_tick);
+    }
+}
+
+// A frame for a symbol with a replay outstanding: either part of the hole
+// (apply it now) or live data past it (hold it)
+template <typename Handler>
+void MarketDataParser::recover(const wire::FrameHeader& h, const uint8_t* frame,
+                               Handler& on_tick) {
+    Recovery& r = recovery_[h.symbol_id];
+
+    if (h.seq > r.to) {
+        hold(h, frame);
+        if (r.held.size() >= MAX_HELD) end_recovery(h.symbol_id, false, on_tick);
+        return;
+    }
+    if (h.seq < r.next) {
+        ++stats_.stale;
+        return;
+    }
+
+    // Replays come in seq order; anything skipped was no longer held
+    if (h.seq != r.next) {
+        stats_.unrecovered += h.seq - r.next;
+        lost(h.symbol_id);
+    }
+    Tick tick{};
+    wire::decode(h, frame, tick);
+    on_tick(tick);
+    last_seq_per_symbol_[h.symbol_id] = h.seq;
+    r.next = h.seq + 1;
+
+    if (h.seq == r.to) end_recovery(h.symbol_id, true, on_tick);
+}
+
+// Close the hole (filled, or given up on) and release the held ticks in
+// order; a further hole among them starts a new recovery
+template <typename Handler>
+void MarketDataParser::end_recovery(uint16_t symbol_id, bool filled,
+                                    Handler& on_tick) {
+    Recovery& r = recovery_[symbol_id];
+    auto& last = last_seq_per_symbol_[symbol_id];
+
+    state_[symbol_id] = Live;
+    recovering_.erase(std::find(recovering_.begin(), recovering_.end(), symbol_id));
+
+    if (filled) {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - r.started).count();
+        ++stats_.recovered;
+        stats_.recovery_ns += ns;
+        stats_.max_recovery_ns = std::max(stats_.max_recovery_ns, ns);
+    } else {
+        ++stats_.recovery_timeouts;
+        stats_.unrecovered += r.to - r.next + 1;
+        last = r.to;   // carry on past the hole, as without recovery
+        lost(symbol_id);
+    }
+
+    std::vector<Tick> held;
+    held.swap(r.held);
+    for (size_t i = 0; i < held.size(); ++i) {
+        uint32_t seq = static_cast<uint32_t>(held[i].seq_no);
+        if (seq <= last) {
+            ++stats_.stale;
+            continue;
+        }
+        if (seq != last + 1 && seq_gap(symbol_id, last + 1, seq)) {
+            r.held.assign(held.begin() + i, held.end());
+            return;
+        }
+        last = seq;
+        on_tick(held[i]);
+    }
+    held.clear();
+    r.held.swap(held);   // keep the capacity for the next hole
+}
+
+template <typename Handler>
+void MarketDataParser::expire_recoveries(Handler& on_tick) {
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < recovering_.size();) {
+        uint16_t sym = recovering_[i];
+        if (now < recovery_[sym].deadline) {
+            ++i;
+            continue;
+        }
+        end_recovery(sym, false, on_tick);   // removes recovering_[i]
+    }
+}
+
 class Visualizer {
 public:
     Visualizer(const LockFreeSymbolCache& cache,
                size_t num_symbols)
         : cache_(cache),
           num_symbols_(num_symbols),
-          running_(true) {
+          running_(true),
+          states_(num_symbols) {
+        // All counts start at 0, so any ids are a valid initial top list
+        for (size_t i = 0; i < std::min<size_t>(TOP_N, num_symbols); ++i)
+            top_.push_back(i);
         setup_stdin();
         start_time_ = std::chrono::steady_clock::now();
     }
@@ -93,6 +504,12 @@ public:
     void run();
     void stop() { running_ = false; }
 
+    // Show the L2 book of the busiest symbol
+    void set_depth_cache(const DepthCache* depth) { depth_ = depth; }
+
+    // Show arbitration results when the feed has more than one line
+    void set_line_stats(std::vector<const LineStats*> lines) { lines_ = std::move(lines); }
+
 private:
     void setup_stdin();
     // void restore_stdin();
@@ -101,10 +518,28 @@ private:
     void clear_screen();
     void print_header(uint64_t msg_count);
     void print_table(const std::vector<size_t>& top);
+    void print_latency();
+    void print_depth(uint32_t symbol);
+    void print_lines();
     void restore_stdin();
     const LockFreeSymbolCache& cache_;
+    const DepthCache* depth_{nullptr};
+    std::vector<const LineStats*> lines_;
     size_t num_symbols_;
     std::atomic<bool> running_;
     std::chrono::steady_clock::time_point start_time_;
+
+    // Local copy of the book, refreshed from the symbols changed since epoch_
+    std::vector<MarketState> states_;
+    std::vector<uint32_t> changed_;
+    std::vector<MarketState> fresh_;
+    uint64_t epoch_{0};
+    uint64_t total_updates_{0};
+
+    // Symbols shown in the table. Counts only grow, so the next top list
+    // is always drawn from this one plus the symbols that just changed.
+    static constexpr size_t TOP_N = 20;
+    std::vector<size_t> top_;
+    std::vector<size_t> candidates_;
 };
 
@@ -6,24 +6,9 @@
 #include <atomic>
 #include "header.h" 
 #include "../common/protocol.h"
+#include "wire.h"
 // #include "../common/latency_tracker.h"
 
-namespace {
-
-// Message types
-constexpr uint16_t MSG_TRADE = 0x01;
-constexpr uint16_t MSG_QUOTE = 0x02;
-constexpr uint16_t MSG_HEARTBEAT = 0x03;
-
-inline uint32_t xor_checksum(const uint8_t* data, size_t len) {
-    uint32_t x = 0;
-    for (size_t i = 0; i < len; ++i)
-        x ^= data[i];
-    return x;
-}
-
-} // anonymous namespace
-
 // MarketDataParser::MarketDataParser()
 //     : write_pos_(0),
 //       read_pos_(0),
@@ -35,135 +20,132 @@ inline uint32_t xor_checksum(const uint8_t* data, size_t len) {
 //       last_seq_per_symbol_(MAX_SYMBOLS, 0) {}
 
 MarketDataParser::MarketDataParser(size_t num_symbols)
-    : write_pos_(0),
-      read_pos_(0),
-      last_seq_per_symbol_(num_symbols, 0) {}
-
-void MarketDataParser::consume(const uint8_t* data,
-                               size_t len,
-                               TickCallback on_tick) {
-    if (len == 0) return;
-
-    if (write_pos_ + len > MAX_BUFFER) {
-        std::cerr << "[PARSER] Buffer overflow risk, resetting\n";
-        reset();
-        return;
+    : staged_(0),
+      last_seq_per_symbol_(num_symbols, 0),
+      state_(num_symbols, Live),
+      recovery_(num_symbols) {}
+
+void MarketDataParser::reset() {
+    staged_ = 0;
+    image_.clear();
+}
+
+void MarketDataParser::reset_session() {
+    reset();
+    std::fill(last_seq_per_symbol_.begin(), last_seq_per_symbol_.end(), 0);
+    std::fill(state_.begin(), state_.end(), Live);
+    for (uint16_t sym : recovering_) recovery_[sym].held.clear();
+    recovering_.clear();
+    in_sync_ = true;
+    resync_bytes_ = 0;
+}
+
+void MarketDataParser::resume_session() {
+    reset();
+    in_sync_ = true;
+    resync_bytes_ = 0;
+
+    // The old connection took any outstanding replays with it
+    auto now = std::chrono::steady_clock::now();
+    for (uint16_t sym : recovering_) {
+        Recovery& r = recovery_[sym];
+        r.deadline = now + recovery_timeout_;
+        gap_request_(sym, r.next, r.to);
     }
+    for (size_t sym = 0; sym < state_.size(); ++sym) {
+        if (state_[sym] == Live && last_seq_per_symbol_[sym] != 0)
+            state_[sym] = Resumed;
+    }
+}
 
-    std::memcpy(buffer_ + write_pos_, data, len);
-    write_pos_ += len;
+void MarketDataParser::set_gap_recovery(GapRequest request,
+                                        std::chrono::milliseconds timeout) {
+    gap_request_ = std::move(request);
+    recovery_timeout_ = timeout;
+}
 
-    parse_loop(on_tick);
+// First frame of a symbol since resume_session(). A seq at or below the
+// last one means the feed restarted rather than continued: start cold.
+void MarketDataParser::resumed(const wire::FrameHeader& h) {
+    state_[h.symbol_id] = Live;
+    if (h.seq <= last_seq_per_symbol_[h.symbol_id])
+        last_seq_per_symbol_[h.symbol_id] = 0;
 }
 
-void MarketDataParser::reset() {
-    write_pos_ = 0;
-    read_pos_ = 0;
+// Returns true if a replay of [expected, got) was requested
+bool MarketDataParser::seq_gap(uint16_t symbol_id, uint32_t expected, uint32_t got) {
+    ++stats_.seq_gaps;
+    std::cerr << "[PARSER] Seq gap sym=" << symbol_id
+            << " expected=" << expected
+            << " got=" << got << "\n";
+    if (start_recovery(symbol_id, expected, got - 1)) return true;
+    lost(symbol_id);
+    return false;
 }
 
-void MarketDataParser::parse_loop(TickCallback on_tick) {
-    while (true) {
-        size_t available = write_pos_ - read_pos_;
-        if (available < HEADER_SIZE + CHECKSUM_SIZE)
-            return;
-
-        const uint8_t* ptr = buffer_ + read_pos_;
-
-        uint16_t type;
-        uint32_t seq;
-        uint64_t ts;
-        uint16_t sym;
-
-        std::memcpy(&type, ptr, 2);
-        std::memcpy(&seq, ptr + 2, 4);
-        std::memcpy(&ts,  ptr + 6, 8);
-        std::memcpy(&sym, ptr + 14, 2);
-
-        size_t payload_size = 0;
-
-        switch (type) {
-        case MSG_TRADE: payload_size = 12; break;
-        case MSG_QUOTE: payload_size = 24; break;
-        case MSG_HEARTBEAT: payload_size = 0; break;
-        default:
-            drop_bytes(1);
-            continue;
-        }
-
-        size_t msg_size = HEADER_SIZE + payload_size + CHECKSUM_SIZE;
-        if (available < msg_size) return;
-
-        uint32_t expected;
-        std::memcpy(&expected, ptr + msg_size - 4, 4);
-
-        if (xor_checksum(ptr, msg_size - 4) != expected) {
-            drop_bytes(1);
-            continue;
-        }
-
-        // ===============================
-        // ✅ SEQUENCE GAP CHECK GOES HERE
-        // ===============================
-        auto& last = last_seq_per_symbol_[sym];
-        if (last != 0 && seq != last + 1) {
-            std::cerr << "[PARSER] Seq gap sym=" << sym
-                    << " expected=" << last + 1
-                    << " got=" << seq << "\n";
-        }
-        last = seq;
-
-
-        Tick tick{};
-        tick.type = static_cast<MsgType>(type);
-        tick.timestamp_ns = ts;
-        tick.symbol_id = sym;
-        tick.seq_no = seq;
-
-        const uint8_t* payload = ptr + HEADER_SIZE;
-
-        if (type == MSG_TRADE) {
-            std::memcpy(&tick.last_trade_price, payload, 8);
-            std::memcpy(&tick.trade_qty, payload + 8, 4);
-        } else if (type == MSG_QUOTE) {
-            std::memcpy(&tick.bid_price, payload, 8);
-            std::memcpy(&tick.bid_qty, payload + 8, 4);
-            std::memcpy(&tick.ask_price, payload + 12, 8);
-            std::memcpy(&tick.ask_qty, payload + 20, 4);
-        }
-        // Latency tracking (end of parse)
-        LatencyTracker::instance().record_userspace(ts);
-        // ⬇⬇⬇ PUT HERE ⬇⬇⬇
-        // ✔️ Sequence gap detection (SAFE PLACE)
-        // if (last_seq_ != 0 && seq != last_seq_ + 1) {
-        //     std::cerr << "[PARSER] Sequence gap detected. "
-        //             << "Expected=" << last_seq_ + 1
-        //             << " Got=" << seq << "\n";
-        // }
-        on_tick(tick);
-        read_pos_ += msg_size;
-    }
+void MarketDataParser::lost(uint16_t symbol_id) {
+    if (gap_lost_) gap_lost_(symbol_id);
+}
 
-    compact();
+bool MarketDataParser::start_recovery(uint16_t symbol_id, uint32_t from, uint32_t to) {
+    if (!gap_request_) return false;
+
+    Recovery& r = recovery_[symbol_id];
+    r.next = from;
+    r.to = to;
+    r.started = std::chrono::steady_clock::now();
+    r.deadline = r.started + recovery_timeout_;
+    r.held.clear();
+    state_[symbol_id] = Recovering;
+    recovering_.push_back(symbol_id);
+    ++stats_.recoveries;
+
+    gap_request_(symbol_id, from, to);
+    return true;
 }
 
-void MarketDataParser::drop_bytes(size_t n) {
-    read_pos_ += n;
-    compact();
+// One level of the L2 image that precedes a Snapshot. A frame for another
+// symbol or seq means the previous image lost its Snapshot: start over.
+void MarketDataParser::depth_image(const wire::FrameHeader& h, const uint8_t* frame) {
+    if (!image_.empty() && (image_[0].symbol_id != h.symbol_id ||
+                            image_[0].seq_no != h.seq))
+        image_.clear();
+    if (image_.size() >= MAX_IMAGE) return;
+
+    Tick tick{};
+    wire::decode(h, frame, tick);
+    image_.push_back(tick);
 }
 
-void MarketDataParser::compact() {
-    if (read_pos_ == 0) return;
+void MarketDataParser::hold(const wire::FrameHeader& h, const uint8_t* frame) {
+    Tick tick{};
+    wire::decode(h, frame, tick);
+    recovery_[h.symbol_id].held.push_back(tick);
+}
+
+void MarketDataParser::unknown_symbol(uint16_t symbol_id) {
+    std::cerr << "[PARSER] Unknown symbol " << symbol_id << "\n";
+}
 
-    if (read_pos_ == write_pos_) {
-        read_pos_ = write_pos_ = 0;
-        return;
+// Resync bookkeeping: parse() skips straight to wire::scan_for_frame()'s hit
+size_t MarketDataParser::skip_bytes(size_t n) {
+    if (in_sync_) {
+        in_sync_ = false;
+        resync_bytes_ = 0;
+        resync_start_ = std::chrono::steady_clock::now();
     }
+    resync_bytes_ += n;
+    stats_.bytes_skipped += n;
+    return n;
+}
 
-    std::memmove(buffer_,
-                 buffer_ + read_pos_,
-                 write_pos_ - read_pos_);
+void MarketDataParser::resynced() {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - resync_start_).count();
 
-    write_pos_ -= read_pos_;
-    read_pos_ = 0;
+    ++stats_.resyncs;
+    stats_.resync_ns += ns;
+    stats_.max_resync_ns = std::max(stats_.max_resync_ns, ns);
+    stats_.max_resync_bytes = std::max(stats_.max_resync_bytes, resync_bytes_);
+    in_sync_ = true;
 }
-
@@ -1,4 +1,5 @@
 #include <sys/epoll.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -10,8 +11,19 @@
 #include <chrono>
 #include <thread>
 #include <vector>
+#include <linux/errqueue.h>    // scm_timestamping
+#include <linux/net_tstamp.h>   // SOF_TIMESTAMPING_*
 #include "protocol.h" 
 #include "header.h" 
+#include "wire.h"
+
+// Older libc headers predate these
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
 // #include "../common/memory_pool.h"
 // #include "../common/latency_tracker.h"
 
@@ -39,12 +51,19 @@ void MarketDataSocket::set_nonblocking(int fd) {
 bool MarketDataSocket::connect(const std::string& host,
                                uint16_t port,
                                uint32_t timeout_ms) {
+    if (!start_connect(host, port)) return false;
+    return wait_for_connect(timeout_ms) && poll_connect() == 1;
+}
+
+bool MarketDataSocket::start_connect(const std::string& host, uint16_t port) {
+    connected_ = false;
     sock_fd_ = socket(AF_INET, SOCK_STREAM, 0);
     if (sock_fd_ < 0) return false;
 
     set_nonblocking(sock_fd_);
     set_tcp_nodelay(true);
     set_recv_buffer_size(4 * 1024 * 1024);
+    enable_rx_timestamps();
 
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
@@ -54,41 +73,68 @@ bool MarketDataSocket::connect(const std::string& host,
     int rc = ::connect(sock_fd_, (sockaddr*)&addr, sizeof(addr));
     if (rc < 0 && errno != EINPROGRESS) {
         close(sock_fd_);
+        sock_fd_ = -1;
         return false;
     }
 
+    // Writable = the attempt has ended, either way
     epoll_event ev{};
-    ev.events = EPOLLIN | EPOLLET;
+    ev.events = EPOLLOUT | EPOLLET;
     ev.data.fd = sock_fd_;
     epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, sock_fd_, &ev);
-
-    connected_ = wait_for_connect(timeout_ms);
-    return connected_;
+    return true;
 }
 
 bool MarketDataSocket::wait_for_connect(uint32_t timeout_ms) {
     epoll_event ev;
-    int n = epoll_wait(epoll_fd_, &ev, 1, timeout_ms);
-    if (n <= 0) return false;
+    return epoll_wait(epoll_fd_, &ev, 1, timeout_ms) > 0;
+}
+
+int MarketDataSocket::poll_connect() {
+    if (sock_fd_ < 0) return -1;
+    if (connected_) return 1;
 
-    int err;
+    pollfd p{sock_fd_, POLLOUT, 0};
+    if (::poll(&p, 1, 0) == 0) return 0;
+
+    int err = 0;
     socklen_t len = sizeof(err);
-    getsockopt(sock_fd_, SOL_SOCKET, SO_ERROR, &err, &len);
-    return err == 0;
+    if (getsockopt(sock_fd_, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+    connected_ = err == 0;
+    return connected_ ? 1 : -1;
 }
 
 ssize_t MarketDataSocket::receive(void* buffer, size_t max_len) {
-    auto before = std::chrono::high_resolution_clock::now();
+    iovec iov{buffer, max_len};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
 
     // ssize_t n = ::recv(fd_, buffer, max_len, MSG_DONTWAIT);
-    ssize_t n = ::recv(sock_fd_, buffer, max_len, MSG_DONTWAIT);
+    ssize_t n = ::recvmsg(sock_fd_, &msg, MSG_DONTWAIT);
 
     if (n > 0) {
-        auto after = std::chrono::high_resolution_clock::now();
-        uint64_t latency_ns =
-            std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count();
-
-        LatencyTracker::instance().record_kernel_to_user(latency_ns);
+        rx_user_ns_ = wall_clock_ns();
+        rx_kernel_ns_ = 0;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET) continue;
+
+            timespec ts{};
+            if (c->cmsg_type == SCM_TIMESTAMPING) {
+                scm_timestamping st;   // ts[0] = software stamp
+                memcpy(&st, CMSG_DATA(c), sizeof(st));
+                ts = st.ts[0];
+            } else if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            } else {
+                continue;
+            }
+            rx_kernel_ns_ = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+        }
         return n;
     }
 
@@ -112,16 +158,48 @@ bool MarketDataSocket::send_subscription(
         const std::vector<uint16_t>& symbol_ids) {
 
     uint16_t count = symbol_ids.size();
-    size_t len = 1 + 2 + count * 2;
+    size_t len = wire::SUBSCRIBE_HEADER_SIZE + count * 2;
 
     std::vector<uint8_t> buf(len);
-    buf[0] = 0xFF;
+    buf[0] = wire::SUBSCRIBE_REQUEST;
     memcpy(&buf[1], &count, 2);
-    memcpy(&buf[3], symbol_ids.data(), count * 2);
+    memcpy(&buf[wire::SUBSCRIBE_HEADER_SIZE], symbol_ids.data(), count * 2);
 
     return send(sock_fd_, buf.data(), buf.size(), 0) == (ssize_t)buf.size();
 }
 
+bool MarketDataSocket::send_retransmit_request(uint16_t symbol_id,
+                                               uint32_t from, uint32_t to) {
+    uint8_t buf[wire::RETRANSMIT_REQUEST_SIZE];
+    size_t len = wire::encode_retransmit_request(buf, symbol_id, from, to);
+
+    // Tiny and rare: the socket buffer always has room unless the link is dead
+    return send(sock_fd_, buf, len, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+bool MarketDataSocket::enable_rx_timestamps() {
+    // Software RX stamps via SO_TIMESTAMPING; SO_TIMESTAMPNS on older kernels
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (setsockopt(sock_fd_, SOL_SOCKET, SO_TIMESTAMPING,
+                   &flags, sizeof(flags)) == 0)
+        return true;
+
+    int on = 1;
+    return setsockopt(sock_fd_, SOL_SOCKET, SO_TIMESTAMPNS,
+                      &on, sizeof(on)) == 0;
+}
+
+bool MarketDataSocket::set_busy_poll(int usec, bool prefer) {
+    bool ok = setsockopt(sock_fd_, SOL_SOCKET, SO_BUSY_POLL,
+                         &usec, sizeof(usec)) == 0;
+    if (prefer) {
+        int on = 1;
+        ok &= setsockopt(sock_fd_, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                         &on, sizeof(on)) == 0;
+    }
+    return ok;
+}
+
 bool MarketDataSocket::set_tcp_nodelay(bool enable) {
     int val = enable ? 1 : 0;
     return setsockopt(sock_fd_, IPPROTO_TCP,
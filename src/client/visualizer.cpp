@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <cstdio>
 #include "header.h" 
 #include "protocol.h"   // MarketState, LatencyTracker
 
@@ -40,7 +41,7 @@ void Visualizer::handle_input() {
             running_ = false;
         }
         if (c == 'r') {
-            std::cout << "\n[visualizer] Stats reset not implemented yet\n";
+            LatencyTracker::instance().reset();
         }
     }
 }
@@ -62,10 +63,7 @@ void Visualizer::print_table(const std::vector<size_t>& top) {
     std::cout << "-------------------------------------------------\n";
 
     for (size_t id : top) {
-        MarketState s {};
-        if (!cache_.getSnapshot(id, s))
-            continue;
-
+        const MarketState& s = states_[id];
         std::cout << id << "   "
                   << s.best_bid << "   "
                   << s.best_ask << "   "
@@ -74,46 +72,127 @@ void Visualizer::print_table(const std::vector<size_t>& top) {
     }
 }
 
+void Visualizer::print_latency() {
+    // One merge per stage per frame; percentiles are then bucket walks
+    static const double pcts[] = {50, 90, 99, 99.9, 99.99};
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-18s %10s %8s %8s %8s %8s %8s %8s\n",
+                  "Latency (us)", "samples", "p50", "p90", "p99", "p99.9",
+                  "p99.99", "max");
+    std::cout << line;
+
+    for (size_t st = 0; st < size_t(LatencyStage::Count); ++st) {
+        LatencyHistogram::Snapshot snap =
+            LatencyTracker::instance().snapshot(LatencyStage(st));
+
+        int n = std::snprintf(line, sizeof(line), "%-18s %10llu",
+                              latency_stage_name(LatencyStage(st)),
+                              (unsigned long long)snap.total);
+        for (double p : pcts)
+            n += std::snprintf(line + n, sizeof(line) - n, " %8.2f",
+                               snap.percentile(p) / 1000.0);
+        std::snprintf(line + n, sizeof(line) - n, " %8.2f\n", snap.max() / 1000.0);
+        std::cout << line;
+    }
+}
+
+void Visualizer::print_lines() {
+    if (lines_.size() < 2) return;
+
+    uint64_t total = 0;
+    for (const LineStats* l : lines_) total += l->wins.load(std::memory_order_relaxed);
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "\n%-22s %10s %7s %10s %8s %8s %8s %8s\n",
+                  "Feed line (us)", "wins", "won %", "dups", "p50", "p99",
+                  "lag p50", "lag p99");
+    std::cout << line;
+    for (const LineStats* l : lines_) {
+        uint64_t wins = l->wins.load(std::memory_order_relaxed);
+        LatencyHistogram::Snapshot lat = l->latency.snapshot();
+        LatencyHistogram::Snapshot lag = l->lag.snapshot();
+        std::snprintf(line, sizeof(line),
+                      "%-22s %10llu %6.1f%% %10llu %8.2f %8.2f %8.2f %8.2f\n",
+                      l->name.c_str(), (unsigned long long)wins,
+                      total ? 100.0 * wins / total : 0.0,
+                      (unsigned long long)l->duplicates.load(std::memory_order_relaxed),
+                      lat.percentile(50) / 1000.0, lat.percentile(99) / 1000.0,
+                      lag.percentile(50) / 1000.0, lag.percentile(99) / 1000.0);
+        std::cout << line;
+    }
+}
+
+void Visualizer::print_depth(uint32_t symbol) {
+    DepthSnapshot book;
+    if (!depth_ || !depth_->tryGetDepth(symbol, book)) return;
+    if (book.bid_levels == 0 && book.ask_levels == 0) return;
+
+    char line[96];
+    std::cout << "\nDepth for symbol " << symbol << ":\n";
+    std::snprintf(line, sizeof(line), "%8s %12s | %-12s %8s\n",
+                  "bid qty", "bid", "ask", "ask qty");
+    std::cout << line;
+
+    size_t rows = std::min<size_t>(5, std::max(book.bid_levels, book.ask_levels));
+    for (size_t i = 0; i < rows; ++i) {
+        int n = 0;
+        if (i < book.bid_levels)
+            n = std::snprintf(line, sizeof(line), "%8u %12.2f | ",
+                              book.bids[i].qty, book.bids[i].price);
+        else
+            n = std::snprintf(line, sizeof(line), "%8s %12s | ", "", "");
+        if (i < book.ask_levels)
+            std::snprintf(line + n, sizeof(line) - n, "%-12.2f %8u\n",
+                          book.asks[i].price, book.asks[i].qty);
+        else
+            std::snprintf(line + n, sizeof(line) - n, "\n");
+        std::cout << line;
+    }
+}
+
 void Visualizer::render() {
     clear_screen();
 
-    uint64_t total_updates = 0;
-    std::vector<size_t> ids(num_symbols_);
-
-    for (size_t i = 0; i < num_symbols_; ++i) {
-        ids[i] = i;
-        MarketState s;
-        if (cache_.getSnapshot(i, s))
-            total_updates += s.update_count;
+    // Re-read only the symbols written since the last frame
+    epoch_ = cache_.changedSince(epoch_, changed_);
+    fresh_.resize(changed_.size());
+    size_t ok = cache_.getSnapshots(changed_.data(), changed_.size(), fresh_.data());
+    for (size_t k = 0; k < changed_.size(); ++k) {
+        // A changed symbol has update_count > 0 unless the bounded read gave up
+        if (ok < changed_.size() && fresh_[k].update_count == 0)
+            cache_.getSnapshot(changed_[k], fresh_[k]);
+
+        MarketState& s = states_[changed_[k]];
+        total_updates_ += fresh_[k].update_count - s.update_count;
+        s = fresh_[k];
     }
-    
 
     // Top 20 symbols by update count
-    size_t topN = std::min<size_t>(20, ids.size());
-    std::partial_sort(ids.begin(), ids.begin()+ topN, ids.end(),
+    candidates_.assign(top_.begin(), top_.end());
+    for (uint32_t id : changed_)
+        if (std::find(top_.begin(), top_.end(), id) == top_.end())
+            candidates_.push_back(id);
+    size_t topN = std::min(TOP_N, candidates_.size());
+    std::partial_sort(candidates_.begin(), candidates_.begin() + topN, candidates_.end(),
         [&](size_t a, size_t b) {
-            MarketState sa, sb;
-            cache_.getSnapshot(a, sa);
-            cache_.getSnapshot(b, sb);
-            return sa.update_count > sb.update_count;
+            return states_[a].update_count > states_[b].update_count;
         });
-    // std::partial_sort(ids.begin(), ids.begin() + 20, ids.end(),
-    //     [&](size_t a, size_t b) {
-    //         MarketState sa, sb;
-    //         cache_.getSnapshot(a, sa);
-    //         cache_.getSnapshot(b, sb);
-    //         return sa.update_count > sb.update_count;
-    //     });
-
-    print_header(total_updates);
-    print_table({ids.begin(), ids.begin() + topN});
-    // print_table({ids.begin(), ids.begin() + std::min<size_t>(20, ids.size())});
+    top_.assign(candidates_.begin(), candidates_.begin() + topN);
+
+    print_header(total_updates_);
+    print_table(top_);
+    if (topN) print_depth(uint32_t(top_[0]));
 
     std::cout << "\nStatistics:\n";
-    std::cout << "Latency p50: " << LatencyTracker::instance().p50() / 1000 << " us\n";
-    std::cout << "Latency p99: " << LatencyTracker::instance().p99() / 1000 << " us\n";
+    print_latency();
+    print_lines();
+
+    LockFreeSymbolCache::ReaderStats rs = cache_.readerStats();
+    std::cout << "Cache reads: " << rs.retries << " retries, "
+              << rs.failures << " gave up\n";
 
-    std::cout << "\nPress 'q' to quit\n";
+    std::cout << "\nPress 'q' to quit, 'r' to reset latency stats\n";
 }
 
 void Visualizer::run() {
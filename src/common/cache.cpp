@@ -1,6 +1,15 @@
 #include <stdexcept>
 #include "protocol.h"
+#include "cache_layout.h"
 #include <vector>
+#include <string>
+#include <new>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 /* ----------------- Internal atomic state ----------------- */
@@ -9,24 +18,163 @@
 //     MarketState state;
 // };
 
-struct alignas(64) AtomicMarketState {
-    std::atomic<uint64_t> seq;
-    MarketState data{};
-};
+// AtomicMarketState lives in cache_layout.h, shared with out-of-process readers
 
 /* ================= PIMPL DEFINITION ================= */
 
 // THIS LINE IS THE FIX
 struct LockFreeSymbolCache::LockFreeSymbolCacheImpl {
-    explicit LockFreeSymbolCacheImpl(size_t n)
-        : symbols(n) {
-            for (auto& s : symbols) {
-                s.data = MarketState{};
-                s.seq.store(0, std::memory_order_relaxed);
+    LockFreeSymbolCacheImpl(size_t n, const char* shm_name)
+        : count(n) {
+            if (shm_name && *shm_name) map_shared(shm_name);
+            if (!symbols) {
+                local.reset(new AtomicMarketState[n]);
+                local_epochs.reset(new std::atomic<uint64_t>[n + cache_layout::epoch_blocks(n)]);
+                symbols = local.get();
+                epoch = &local_epoch;
+                symbol_epochs = local_epochs.get();
+                block_epochs = symbol_epochs + n;
+            }
+            for (size_t i = 0; i < n; ++i) {
+                symbols[i].data = MarketState{};
+                symbols[i].seq.store(0, std::memory_order_relaxed);
+                symbol_epochs[i].store(0, std::memory_order_relaxed);
             }
+            for (size_t b = 0; b < cache_layout::epoch_blocks(n); ++b)
+                block_epochs[b].store(0, std::memory_order_relaxed);
+            epoch->store(0, std::memory_order_relaxed);
+            if (map) {
+                // Publish: readers treat the segment as absent until magic is set
+                auto* hdr = static_cast<cache_layout::Header*>(map);
+                hdr->magic.store(cache_layout::MAGIC, std::memory_order_release);
+            }
+        }
+
+    ~LockFreeSymbolCacheImpl() {
+        if (map) {
+            munmap(map, map_len);
+            // The name may have been taken over after we were presumed dead
+            if (names_segment(shm.c_str(), shm_dev, shm_ino))
+                shm_unlink(shm.c_str());
         }
+    }
+
+    // True if `name` currently refers to the segment with this dev/inode
+    static bool names_segment(const char* name, dev_t dev, ino_t ino) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st{};
+        bool same = fstat(fd, &st) == 0 && st.st_dev == dev && st.st_ino == ino;
+        close(fd);
+        return same;
+    }
 
-    std::vector<AtomicMarketState> symbols;
+    // False if `name` exists and its writer may still be running. A
+    // segment whose writer never got as far as stamping its pid is stale.
+    static bool claimable(const char* name) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return errno == ENOENT;
+
+        uint64_t pid = 0;
+        struct stat st{};
+        if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(cache_layout::Header)) {
+            void* p = mmap(nullptr, sizeof(cache_layout::Header), PROT_READ,
+                           MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                pid = static_cast<const cache_layout::Header*>(p)->writer_pid;
+                munmap(p, sizeof(cache_layout::Header));
+            }
+        }
+        close(fd);
+        return pid == 0 || (kill(pid_t(pid), 0) != 0 && errno == ESRCH);
+    }
+
+    // Slots go into a fresh named segment. A leftover segment from a
+    // writer that died is unlinked first; readers still attached to it keep
+    // their (now frozen) view and can tell via the header's writer_pid. A
+    // segment whose writer is alive is left alone and we stay process-local.
+    void map_shared(const char* name) {
+        if (!claimable(name)) return;
+        shm_unlink(name);
+        int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) return;
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            shm_unlink(name);
+            return;
+        }
+
+        size_t len = cache_layout::mapping_size(count);
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, off_t(len)) == 0)
+            p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(name);
+            return;
+        }
+
+        auto* hdr = new (p) cache_layout::Header;
+        hdr->magic.store(0, std::memory_order_relaxed);
+        hdr->version = cache_layout::LAYOUT_VERSION;
+        hdr->header_size = sizeof(cache_layout::Header);
+        hdr->slot_size = sizeof(AtomicMarketState);
+        hdr->num_symbols = uint32_t(count);
+        hdr->writer_pid = uint64_t(getpid());
+        hdr->created_ns = wall_clock_ns();
+        hdr->symbol_epochs_offset = cache_layout::symbol_epochs_offset(count);
+        hdr->block_epochs_offset = cache_layout::block_epochs_offset(count);
+
+        uint8_t* base = static_cast<uint8_t*>(p);
+        auto* slots = reinterpret_cast<AtomicMarketState*>(base + sizeof(cache_layout::Header));
+        for (size_t i = 0; i < count; ++i) new (&slots[i]) AtomicMarketState;
+
+        auto* sym_ep = reinterpret_cast<std::atomic<uint64_t>*>(base + hdr->symbol_epochs_offset);
+        auto* blk_ep = reinterpret_cast<std::atomic<uint64_t>*>(base + hdr->block_epochs_offset);
+        for (size_t i = 0; i < count; ++i) new (&sym_ep[i]) std::atomic<uint64_t>;
+        for (size_t b = 0; b < cache_layout::epoch_blocks(count); ++b)
+            new (&blk_ep[b]) std::atomic<uint64_t>;
+
+        map = p;
+        map_len = len;
+        shm = name;
+        shm_dev = st.st_dev;
+        shm_ino = st.st_ino;
+        symbols = slots;
+        epoch = &hdr->epoch;
+        symbol_epochs = sym_ep;
+        block_epochs = blk_ep;
+    }
+
+    void changed(uint32_t symbol) {
+        cache_layout::publish_change(symbol, next_epoch, *epoch,
+                                     symbol_epochs, block_epochs);
+    }
+
+    AtomicMarketState* symbols = nullptr;
+    size_t count;
+
+    // Backing store: a process-local array, or a shared-memory mapping
+    std::unique_ptr<AtomicMarketState[]> local;
+    void* map = nullptr;
+    size_t map_len = 0;
+    std::string shm;
+    dev_t shm_dev = 0;
+    ino_t shm_ino = 0;
+
+    // Change epochs (cache_layout.h); in the segment when shared
+    std::atomic<uint64_t>* epoch = nullptr;
+    std::atomic<uint64_t>* symbol_epochs = nullptr;
+    std::atomic<uint64_t>* block_epochs = nullptr;
+    uint64_t next_epoch = 1;   // writer-private
+    std::unique_ptr<std::atomic<uint64_t>[]> local_epochs;
+    alignas(64) std::atomic<uint64_t> local_epoch{0};
+
+    // Reader contention; bumped only on the slow path
+    alignas(64) std::atomic<uint64_t> read_retries{0};
+    std::atomic<uint64_t> read_failures{0};
 };
 
 /* ----------------- helpers ----------------- */
@@ -38,18 +186,27 @@ struct LockFreeSymbolCache::LockFreeSymbolCacheImpl {
 //     s.version.fetch_add(1, std::memory_order_release);
 // }
 
-static inline void begin_write(AtomicMarketState& s) {
-    s.seq.fetch_add(1, std::memory_order_release); // odd = write begin
+// Single writer: seq is only ever modified here, so plain stores replace
+// the locked RMWs. The fence keeps the payload stores below the odd mark.
+static inline uint64_t begin_write(AtomicMarketState& s) {
+    uint64_t seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed); // odd = write begin
+    std::atomic_thread_fence(std::memory_order_release);
+    return seq;
 }
 
-static inline void end_write(AtomicMarketState& s) {
-    s.seq.fetch_add(1, std::memory_order_release); // even = write end
+static inline void end_write(AtomicMarketState& s, uint64_t seq) {
+    s.seq.store(seq + 2, std::memory_order_release); // even = write end
 }
 
 /* ================= API IMPLEMENTATION ================= */
 
-LockFreeSymbolCache::LockFreeSymbolCache(size_t num_symbols)
-    : impl_(std::make_unique<LockFreeSymbolCacheImpl>(num_symbols)) {}
+LockFreeSymbolCache::LockFreeSymbolCache(size_t num_symbols, const char* shm_name)
+    : impl_(std::make_unique<LockFreeSymbolCacheImpl>(num_symbols, shm_name)) {}
+
+bool LockFreeSymbolCache::shared() const {
+    return impl_->map != nullptr;
+}
 
 LockFreeSymbolCache::~LockFreeSymbolCache() = default;
 
@@ -59,7 +216,7 @@ void LockFreeSymbolCache::updateBid(
 
     // auto& s = symbols_[symbol];
     auto& s = impl_->symbols[symbol];
-    begin_write(s);
+    uint64_t seq = begin_write(s);
 
     s.data.best_bid = price;
     s.data.bid_quantity = qty;
@@ -71,7 +228,8 @@ void LockFreeSymbolCache::updateBid(
     // s.state.last_update_time = ts;
     // s.state.update_count++;
 
-    end_write(s);
+    end_write(s, seq);
+    impl_->changed(symbol);
 }
 
 void LockFreeSymbolCache::updateAsk(
@@ -79,7 +237,7 @@ void LockFreeSymbolCache::updateAsk(
 
     // auto& s = symbols_[symbol];
     auto& s = impl_->symbols[symbol];
-    begin_write(s);
+    uint64_t seq = begin_write(s);
 
     s.data.best_ask = price;
     s.data.ask_quantity = qty;
@@ -90,7 +248,8 @@ void LockFreeSymbolCache::updateAsk(
     // s.state.last_update_time = ts;
     // s.state.update_count++;
 
-    end_write(s);
+    end_write(s, seq);
+    impl_->changed(symbol);
 }
 
 
@@ -135,18 +294,66 @@ bool LockFreeSymbolCache::getSnapshot(
 
     const auto& s = impl_->symbols[symbol];
 
-    while (true) {
-        uint64_t start = s.seq.load(std::memory_order_acquire);
-        if (start & 1) continue;
+    for (unsigned attempt = 0;; ++attempt) {
+        if (cache_layout::read_once(s, out)) {
+            if (attempt)
+                impl_->read_retries.fetch_add(attempt, std::memory_order_relaxed);
+            return true;
+        }
+        cache_layout::read_backoff(attempt, SPIN_RETRIES);
+    }
+}
 
-        out = s.data;
+bool LockFreeSymbolCache::tryGetSnapshot(
+    uint32_t symbol, MarketState& out, unsigned max_retries) const {
+
+    unsigned retries = 0;
+    bool ok = cache_layout::read_bounded(impl_->symbols[symbol], out,
+                                         max_retries, SPIN_RETRIES, retries);
+    if (retries)
+        impl_->read_retries.fetch_add(retries, std::memory_order_relaxed);
+    if (!ok)
+        impl_->read_failures.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
 
-        uint64_t end = s.seq.load(std::memory_order_acquire);
-        if (start == end)
-            return true;
+size_t LockFreeSymbolCache::getSnapshots(
+    const uint32_t* ids, size_t n, MarketState* out, unsigned max_retries) const {
+
+    const AtomicMarketState* symbols = impl_->symbols;
+    size_t ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        // Scans are usually scattered: pull the line a few symbols ahead
+        if (i + 4 < n) __builtin_prefetch(&symbols[ids[i + 4]]);
+
+        if (tryGetSnapshot(ids[i], out[i], max_retries)) ++ok;
+        else out[i] = MarketState{};
     }
-}size_t LockFreeSymbolCache::size() const {
-    return impl_->symbols.size();
+    return ok;
+}
+
+uint64_t LockFreeSymbolCache::epoch() const {
+    return impl_->epoch->load(std::memory_order_acquire);
+}
+
+uint64_t LockFreeSymbolCache::symbolEpoch(uint32_t symbol) const {
+    return impl_->symbol_epochs[symbol].load(std::memory_order_acquire);
+}
+
+uint64_t LockFreeSymbolCache::changedSince(
+    uint64_t since, std::vector<uint32_t>& out) const {
+    return cache_layout::changed_since(*impl_->epoch, impl_->symbol_epochs,
+                                       impl_->block_epochs, impl_->count,
+                                       since, out);
+}
+
+LockFreeSymbolCache::ReaderStats LockFreeSymbolCache::readerStats() const {
+    return {impl_->read_retries.load(std::memory_order_relaxed),
+            impl_->read_failures.load(std::memory_order_relaxed)};
+}
+
+size_t LockFreeSymbolCache::size() const {
+    return impl_->count;
 }
 
 void LockFreeSymbolCache::updateTrade(
@@ -154,7 +361,7 @@ void LockFreeSymbolCache::updateTrade(
 
     // auto& s = impl_->symbols[symbol];
     auto& s = impl_->symbols[symbol];
-    begin_write(s);
+    uint64_t seq = begin_write(s);
 
     s.data.last_traded_price = price;
     s.data.last_traded_quantity = qty;
@@ -166,5 +373,63 @@ void LockFreeSymbolCache::updateTrade(
     // s.state.last_update_time = ts;
     // s.state.update_count++;
 
-    end_write(s);
+    end_write(s, seq);
+    impl_->changed(symbol);
+}
+
+// ---- Whole-message writes: one critical section per tick ----
+void LockFreeSymbolCache::applyQuote(const Tick& tick) {
+    auto& s = impl_->symbols[tick.symbol_id];
+    uint64_t seq = begin_write(s);
+
+    s.data.best_bid = tick.bid_price;
+    s.data.bid_quantity = tick.bid_qty;
+    s.data.best_ask = tick.ask_price;
+    s.data.ask_quantity = tick.ask_qty;
+    s.data.last_update_time = tick.timestamp_ns;
+    s.data.update_count++;
+
+    end_write(s, seq);
+    impl_->changed(tick.symbol_id);
+}
+
+void LockFreeSymbolCache::applyTrade(const Tick& tick) {
+    auto& s = impl_->symbols[tick.symbol_id];
+    uint64_t seq = begin_write(s);
+
+    s.data.last_traded_price = tick.last_trade_price;
+    s.data.last_traded_quantity = tick.trade_qty;
+    s.data.last_update_time = tick.timestamp_ns;
+    s.data.update_count++;
+
+    end_write(s, seq);
+    impl_->changed(tick.symbol_id);
+}
+
+void LockFreeSymbolCache::applySnapshot(const Tick& tick) {
+    auto& s = impl_->symbols[tick.symbol_id];
+    uint64_t seq = begin_write(s);
+
+    s.data.best_bid = tick.bid_price;
+    s.data.bid_quantity = tick.bid_qty;
+    s.data.best_ask = tick.ask_price;
+    s.data.ask_quantity = tick.ask_qty;
+    s.data.last_traded_price = tick.last_trade_price;
+    s.data.last_traded_quantity = tick.trade_qty;
+    s.data.last_update_time = tick.timestamp_ns;
+    s.data.update_count++;
+
+    end_write(s, seq);
+    impl_->changed(tick.symbol_id);
+}
+
+void LockFreeSymbolCache::applyBatch(const Tick* ticks, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        // A snapshot burst touches every slot once: fetch ahead of the writes
+        if (i + 4 < n) __builtin_prefetch(&impl_->symbols[ticks[i + 4].symbol_id], 1);
+
+        if (ticks[i].type == MsgType::Trade)         applyTrade(ticks[i]);
+        else if (ticks[i].type == MsgType::Quote)    applyQuote(ticks[i]);
+        else if (ticks[i].type == MsgType::Snapshot) applySnapshot(ticks[i]);
+    }
 }
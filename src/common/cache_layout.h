@@ -0,0 +1,149 @@
+// src/common/cache_layout.h
+#pragma once
+#include "protocol.h"
+#include "tsc_clock.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+
+/* ---------------- Cache slot layout ----------------
+ * One seqlock-protected MarketState per symbol, one cache line each. This
+ * is the in-process layout of LockFreeSymbolCache and, byte for byte, the
+ * slot array of the shared-memory export. The read helpers below are the
+ * only correct way to copy a slot out, in or out of process.
+ */
+struct alignas(64) AtomicMarketState {
+    std::atomic<uint64_t> seq;   // odd while the writer is mid-update
+    MarketState data{};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "seqlock counter must be lock-free to be shared across processes");
+static_assert(std::is_trivially_copyable<MarketState>::value,
+              "MarketState is copied out of shared memory with plain loads");
+
+namespace cache_layout {
+
+// One read attempt. The acquire fence keeps the payload loads above the
+// second seq load; an acquire load alone would let them sink below it.
+inline bool read_once(const AtomicMarketState& s, MarketState& out) {
+    uint64_t start = s.seq.load(std::memory_order_acquire);
+    if (start & 1) return false;   // writer in progress
+
+    out = s.data;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s.seq.load(std::memory_order_relaxed) == start;
+}
+
+// Pause while the writer is likely mid-section, then give the core away
+inline void read_backoff(unsigned attempt, unsigned spin_retries) {
+    if (attempt < spin_retries) TscClock::cpu_relax();
+    else std::this_thread::yield();
+}
+
+// Up to max_retries + 1 attempts; `retries` gets the number of failed ones
+inline bool read_bounded(const AtomicMarketState& s, MarketState& out,
+                         unsigned max_retries, unsigned spin_retries,
+                         unsigned& retries) {
+    for (unsigned attempt = 0; attempt <= max_retries; ++attempt) {
+        if (read_once(s, out)) {
+            retries = attempt;
+            return true;
+        }
+        if (attempt < max_retries) read_backoff(attempt, spin_retries);
+    }
+    retries = max_retries;
+    return false;
+}
+
+/* ---- Change epochs ----
+ * Every write takes the next value of a global epoch and stamps it on the
+ * symbol and on the symbol's block of EPOCH_BLOCK symbols, then publishes
+ * the global epoch with release order. changed_since(E) reads the global
+ * epoch first, skips blocks whose stamp is <= E and only then looks at
+ * individual symbols, so a reader's cost follows activity rather than the
+ * universe size. Any number of readers keep their own cursor; nothing is
+ * cleared on read. A symbol written while the scan runs may be reported
+ * twice (now and on the next call) but never missed.
+ */
+constexpr size_t EPOCH_BLOCK = 64;
+
+inline size_t epoch_blocks(size_t num_symbols) {
+    return (num_symbols + EPOCH_BLOCK - 1) / EPOCH_BLOCK;
+}
+
+// Writer side (single thread); next_epoch is writer-private
+inline void publish_change(uint32_t symbol, uint64_t& next_epoch,
+                           std::atomic<uint64_t>& epoch,
+                           std::atomic<uint64_t>* symbol_epochs,
+                           std::atomic<uint64_t>* block_epochs) {
+    uint64_t e = next_epoch++;
+    symbol_epochs[symbol].store(e, std::memory_order_relaxed);
+    block_epochs[symbol / EPOCH_BLOCK].store(e, std::memory_order_relaxed);
+    epoch.store(e, std::memory_order_release);
+}
+
+// Fills `out` with symbols changed after `since`; returns the next cursor
+inline uint64_t changed_since(const std::atomic<uint64_t>& epoch,
+                              const std::atomic<uint64_t>* symbol_epochs,
+                              const std::atomic<uint64_t>* block_epochs,
+                              size_t num_symbols, uint64_t since,
+                              std::vector<uint32_t>& out) {
+    out.clear();
+    uint64_t now = epoch.load(std::memory_order_acquire);
+    if (now <= since) return now;
+
+    for (size_t b = 0, nb = epoch_blocks(num_symbols); b < nb; ++b) {
+        if (block_epochs[b].load(std::memory_order_relaxed) <= since) continue;
+        size_t end = std::min(num_symbols, (b + 1) * EPOCH_BLOCK);
+        for (size_t i = b * EPOCH_BLOCK; i < end; ++i) {
+            if (symbol_epochs[i].load(std::memory_order_relaxed) > since)
+                out.push_back(uint32_t(i));
+        }
+    }
+    return now;
+}
+
+/* ---- Shared-memory export ----
+ * [Header][AtomicMarketState x num_symbols][symbol epochs][block epochs],
+ * each part at the offset recorded in the header. The creator fills in the
+ * header and stores `magic` last with release order. A reader that sees
+ * MAGIC with a matching version and sizes may use the segment.
+ * LAYOUT_VERSION changes whenever the header or segment layout does.
+ */
+constexpr uint64_t MAGIC = 0x314843444b4d5846ULL;   // "FXMKDCH1"
+constexpr uint32_t LAYOUT_VERSION = 2;   // 2: change epochs
+
+struct alignas(64) Header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t header_size;   // offset of the slot array
+    uint32_t slot_size;     // sizeof(AtomicMarketState)
+    uint32_t num_symbols;
+    uint64_t writer_pid;
+    uint64_t created_ns;    // wall_clock_ns() at creation
+    uint64_t symbol_epochs_offset;
+    uint64_t block_epochs_offset;
+
+    alignas(64) std::atomic<uint64_t> epoch;   // latest published change
+};
+
+inline size_t symbol_epochs_offset(size_t num_symbols) {
+    return sizeof(Header) + num_symbols * sizeof(AtomicMarketState);
+}
+
+inline size_t block_epochs_offset(size_t num_symbols) {
+    return symbol_epochs_offset(num_symbols) + num_symbols * sizeof(uint64_t);
+}
+
+inline size_t mapping_size(size_t num_symbols) {
+    return block_epochs_offset(num_symbols)
+         + epoch_blocks(num_symbols) * sizeof(uint64_t);
+}
+
+} // namespace cache_layout
@@ -0,0 +1,203 @@
+// src/common/capture_journal.cpp
+#include "capture_journal.h"
+#include "protocol.h"   // wall_clock_ns
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string capture::segment_path(const std::string& path, uint64_t segment) {
+    char suffix[24];
+    std::snprintf(suffix, sizeof(suffix), ".%06llu", (unsigned long long)segment);
+    return path + suffix;
+}
+
+CaptureJournal::CaptureJournal(const std::string& path, size_t segment_bytes)
+    : path_(path),
+      segment_bytes_(std::max<size_t>(segment_bytes, 1 << 20)),
+      session_(wall_clock_ns() ^ (uint64_t(getpid()) << 48)) {
+    // The reader takes `path` itself for a single segment: don't hide behind it
+    struct stat st{};
+    if (stat(path.c_str(), &st) == 0) {
+        std::fprintf(stderr, "[capture] %s exists, not overwriting\n", path.c_str());
+        return;
+    }
+    current_ = open_segment(next_index_++);
+    if (!current_) return;
+    segments_ = 1;
+    thread_ = std::thread([this] { background(); });
+}
+
+CaptureJournal::~CaptureJournal() {
+    running_.store(false, std::memory_order_relaxed);
+    if (thread_.joinable()) thread_.join();
+
+    close_segment(retired_.exchange(nullptr));
+    close_segment(current_);
+
+    // Prepared but never written: leave no empty segment behind
+    if (Segment* s = ready_.exchange(nullptr)) {
+        s->end = 0;
+        close_segment(s);
+        std::remove(capture::segment_path(path_, next_index_ - 1).c_str());
+    }
+}
+
+void CaptureJournal::append(uint16_t line, uint64_t rx_ns, uint64_t kernel_rx_ns,
+                            const uint8_t* data, size_t len, uint16_t flags) {
+    size_t need = capture::record_size(len);
+    if (current_->end + need > current_->size) {
+        // Roll over. Retire first: the background thread prepares the
+        // next segment only while nothing is waiting to be retired.
+        Segment* next = ready_.load(std::memory_order_acquire);
+        if (!next || sizeof(capture::Header) + need > next->size) {
+            ++dropped_;
+            return;
+        }
+        retired_.store(current_, std::memory_order_release);
+        ready_.store(nullptr, std::memory_order_release);
+        current_ = next;
+        ++segments_;
+    }
+
+    uint8_t* p = current_->base + current_->end;
+    capture::Record rec{rx_ns, kernel_rx_ns, uint32_t(len), line, flags};
+    std::memcpy(p, &rec, sizeof(rec));
+    std::memcpy(p + sizeof(rec), data, len);
+    // The file is zero-filled, so padding and the next record's len are
+    // already 0: a reader stops right here until the next append
+
+    current_->end += need;
+    reinterpret_cast<capture::Header*>(current_->base)->end = current_->end;
+    ++chunks_;
+    bytes_ += len;
+}
+
+// Create, preallocate, map and prefault one segment
+CaptureJournal::Segment* CaptureJournal::open_segment(uint64_t index) {
+    std::string name = capture::segment_path(path_, index);
+    int fd = open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        // Left over from another capture: keep it, and say so once
+        if (errno == EEXIST && !blocked_)
+            std::fprintf(stderr, "[capture] %s exists, not overwriting\n", name.c_str());
+        blocked_ |= errno == EEXIST;
+        return nullptr;
+    }
+
+    void* p = MAP_FAILED;
+    if (posix_fallocate(fd, 0, off_t(segment_bytes_)) == 0)
+        p = mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        std::remove(name.c_str());
+        return nullptr;
+    }
+
+    // Write-fault every page now, off the hot path. Writeback may clean a
+    // page again before it is used; that costs a minor fault, not I/O.
+    uint8_t* base = static_cast<uint8_t*>(p);
+    for (size_t off = 0; off < segment_bytes_; off += 4096) base[off] = 0;
+
+    auto* hdr = reinterpret_cast<capture::Header*>(base);
+    hdr->magic = capture::MAGIC;
+    hdr->version = capture::FORMAT_VERSION;
+    hdr->header_size = sizeof(capture::Header);
+    hdr->segment = index;
+    hdr->created_ns = wall_clock_ns();
+    hdr->end = sizeof(capture::Header);
+    hdr->session = session_;
+
+    Segment* s = new Segment;
+    s->base = base;
+    s->size = segment_bytes_;
+    s->end = sizeof(capture::Header);
+    s->fd = fd;
+    return s;
+}
+
+// Trim the preallocated tail so the file is just its records
+void CaptureJournal::close_segment(Segment* s) {
+    if (!s) return;
+    munmap(s->base, s->size);
+    if (ftruncate(s->fd, off_t(s->end)) != 0)
+        std::perror("[capture] ftruncate");
+    close(s->fd);
+    delete s;
+}
+
+void CaptureJournal::background() {
+    while (running_.load(std::memory_order_relaxed)) {
+        if (Segment* full = retired_.exchange(nullptr, std::memory_order_acquire))
+            close_segment(full);
+
+        if (!blocked_ && !ready_.load(std::memory_order_acquire) &&
+            !retired_.load(std::memory_order_acquire)) {
+            if (Segment* s = open_segment(next_index_)) {
+                ++next_index_;
+                ready_.store(s, std::memory_order_release);
+            }
+        }
+        // Rollovers are many MiB apart; polling keeps append() free of wakeups
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+/* ---- CaptureReader ---- */
+CaptureReader::CaptureReader(const std::string& path) {
+    if (map_segment(path, -1)) return;
+    for (int64_t seg = 0; map_segment(capture::segment_path(path, seg), seg); ++seg) {}
+}
+
+CaptureReader::~CaptureReader() {
+    for (const Mapping& m : maps_) munmap(m.base, m.len);
+}
+
+// `segment` is the index expected in the header, -1 for a lone file
+bool CaptureReader::map_segment(const std::string& name, int64_t segment) {
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st{};
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(capture::Header))
+        p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    size_t len = size_t(st.st_size);
+    const uint8_t* base = static_cast<const uint8_t*>(p);
+    const auto* hdr = reinterpret_cast<const capture::Header*>(base);
+    if (hdr->magic != capture::MAGIC || hdr->version != capture::FORMAT_VERSION) {
+        munmap(p, len);
+        return false;
+    }
+    if (segment >= 0 && (hdr->segment != uint64_t(segment) ||
+                         (segment > 0 && hdr->session != session_))) {
+        std::fprintf(stderr, "[capture] Ignoring %s: not part of this capture\n",
+                     name.c_str());
+        munmap(p, len);
+        return false;
+    }
+    session_ = hdr->session;
+    maps_.push_back(Mapping{p, len});
+
+    // A writer that died leaves the preallocated tail: stop at len 0
+    size_t end = std::min<size_t>(hdr->end, len);
+    size_t off = hdr->header_size;
+    while (off + sizeof(capture::Record) <= end) {
+        capture::Record rec;
+        std::memcpy(&rec, base + off, sizeof(rec));
+        if (rec.len == 0 || off + capture::record_size(rec.len) > end) break;
+        chunks_.push_back(Chunk{base + off + sizeof(rec), rec.len, rec.line,
+                                rec.flags, rec.rx_ns, rec.kernel_rx_ns});
+        off += capture::record_size(rec.len);
+    }
+    return true;
+}
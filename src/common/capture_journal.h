@@ -0,0 +1,160 @@
+// src/common/capture_journal.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* ---------------- Capture file format ----------------
+ * A capture is a series of segment files, <path>.000000, <path>.000001,
+ * ... Each one starts with a 64-byte Header and then holds records back to
+ * back. A record is a 24-byte Record followed by `len` bytes exactly as
+ * recv() returned them, padded to 8. A record with len 0, or the end
+ * offset in the header, marks the end of the data. Every segment of one
+ * capture carries the same session id, so a reader can tell its segments
+ * from leftovers of an earlier capture under the same path.
+ */
+namespace capture {
+
+constexpr uint64_t MAGIC = 0x3130504143444d4dULL;   // "MMDCAP01"
+constexpr uint32_t FORMAT_VERSION = 2;
+
+// Record flags
+constexpr uint16_t RECORD_CONNECT = 1;   // first chunk of a new connection on its line
+
+struct alignas(64) Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;   // offset of the first record
+    uint64_t segment;       // index within the capture
+    uint64_t created_ns;    // wall_clock_ns() at creation
+    uint64_t end;           // offset just past the last complete record
+    uint64_t session;       // same in every segment of the capture
+};
+
+struct Record {
+    uint64_t rx_ns;          // wall_clock_ns() when recv() returned
+    uint64_t kernel_rx_ns;   // SO_TIMESTAMPNS stamp, 0 if unavailable
+    uint32_t len;            // payload bytes
+    uint16_t line;           // feed line the chunk arrived on
+    uint16_t flags;          // RECORD_*
+};
+
+static_assert(sizeof(Header) == 64, "capture header is one cache line");
+static_assert(sizeof(Record) == 24, "capture record header is 24 bytes");
+
+inline size_t record_size(size_t len) {
+    return sizeof(Record) + ((len + 7) & ~size_t(7));
+}
+
+std::string segment_path(const std::string& path, uint64_t segment);
+
+} // namespace capture
+
+/* ---------------- CaptureJournal ----------------
+ * Append-only recorder for received byte chunks. Segments are preallocated
+ * (fallocate), mapped and prefaulted by a background thread, so append()
+ * is a bounds check, a memcpy into the mapping and a header store: no
+ * syscall, no allocation. When the current segment fills, append() swaps
+ * in the segment the background thread already has ready and hands the
+ * full one back to be trimmed to its end offset and closed. If the next
+ * segment is not ready yet, the chunk is dropped and counted rather than
+ * stalling the feed. Single writer. Segment files are created exclusively:
+ * a capture never overwrites an existing one.
+ */
+class CaptureJournal {
+public:
+    CaptureJournal(const std::string& path, size_t segment_bytes);
+    ~CaptureJournal();
+
+    CaptureJournal(const CaptureJournal&) = delete;
+    CaptureJournal& operator=(const CaptureJournal&) = delete;
+
+    // False if the first segment could not be created, e.g. because a
+    // capture already exists at `path`
+    bool valid() const { return current_ != nullptr; }
+
+    // Hot path
+    void append(uint16_t line, uint64_t rx_ns, uint64_t kernel_rx_ns,
+                const uint8_t* data, size_t len, uint16_t flags = 0);
+
+    uint64_t chunks() const { return chunks_; }
+    uint64_t bytes() const { return bytes_; }
+    uint64_t dropped() const { return dropped_; }
+    uint64_t segments() const { return segments_; }
+
+private:
+    struct Segment {
+        uint8_t* base{nullptr};
+        size_t size{0};
+        size_t end{0};
+        int fd{-1};
+    };
+
+    Segment* open_segment(uint64_t index);
+    void close_segment(Segment* s);
+    void background();
+
+    std::string path_;
+    size_t segment_bytes_;
+    uint64_t session_;
+
+    Segment* current_{nullptr};
+    uint64_t chunks_{0};
+    uint64_t bytes_{0};
+    uint64_t dropped_{0};
+    uint64_t segments_{0};
+
+    // Handoff with the background thread. It only prepares a segment once
+    // the previous full one has been retired, so each slot holds at most one.
+    std::atomic<Segment*> ready_{nullptr};
+    std::atomic<Segment*> retired_{nullptr};
+    std::atomic<bool> running_{true};
+    uint64_t next_index_{0};   // background thread only, after construction
+    bool blocked_{false};      // a segment path was taken: prepare no more
+    std::thread thread_;
+};
+
+/* ---------------- CaptureReader ----------------
+ * Read side of a capture: maps every segment of `path` (or `path` itself
+ * when it is a single segment file) read-only and lists the records in
+ * order. It stops at the first segment that is missing or whose index or
+ * session does not follow on from segment 0. Chunk data points into the
+ * mappings, which live as long as the reader.
+ */
+class CaptureReader {
+public:
+    struct Chunk {
+        const uint8_t* data;
+        uint32_t len;
+        uint16_t line;
+        uint16_t flags;
+        uint64_t rx_ns;
+        uint64_t kernel_rx_ns;
+    };
+
+    explicit CaptureReader(const std::string& path);
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    // False if no readable segment was found
+    bool valid() const { return !maps_.empty(); }
+
+    size_t segments() const { return maps_.size(); }
+    const std::vector<Chunk>& chunks() const { return chunks_; }
+
+private:
+    bool map_segment(const std::string& name, int64_t segment);
+
+    struct Mapping {
+        void* base;
+        size_t len;
+    };
+    std::vector<Mapping> maps_;
+    std::vector<Chunk> chunks_;
+    uint64_t session_{0};
+};
@@ -0,0 +1,127 @@
+// src/common/depth_cache.cpp
+#include "depth_cache.h"
+#include "cache_layout.h"
+#include <algorithm>
+#include <cstring>
+
+DepthCache::DepthCache(size_t num_symbols, size_t depth)
+    : num_symbols_(num_symbols),
+      depth_(std::min(std::max<size_t>(depth, 1), DepthSnapshot::MAX_DEPTH)),
+      headers_(new BookHeader[num_symbols]),
+      levels_(new PriceLevel[num_symbols * 2 * depth_]) {}
+
+// ---- Writer API ----
+void DepthCache::apply(const Tick& tick) {
+    if (tick.type == MsgType::DepthUpdate) {
+        if (tick.symbol_id >= num_symbols_ || headers_[tick.symbol_id].stale) return;
+    } else if (tick.type != MsgType::DepthImage) {
+        return;
+    }
+    applyLevel(tick.symbol_id, tick.depth_side, tick.depth_action,
+               tick.depth_level, tick.depth_price, tick.depth_qty,
+               tick.timestamp_ns);
+}
+
+void DepthCache::applyLevel(uint32_t symbol, Side side, DepthAction action,
+                            uint8_t level, double price, uint32_t qty,
+                            uint64_t ts) {
+    if (symbol >= num_symbols_ || size_t(side) > 1) return;
+
+    BookHeader& h = headers_[symbol];
+    uint32_t& count = h.levels[size_t(side)];
+    PriceLevel* lv = side_levels(symbol, side);
+
+    // Seqlock write section (see begin_write/end_write in cache.cpp)
+    uint64_t seq = h.seq.load(std::memory_order_relaxed);
+    h.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    switch (action) {
+    case DepthAction::New:
+        if (level <= count && level < depth_) {
+            size_t keep = std::min<size_t>(count, depth_ - 1);   // last falls off
+            std::memmove(lv + level + 1, lv + level,
+                         (keep - level) * sizeof(PriceLevel));
+            lv[level] = PriceLevel{price, qty};
+            count = uint32_t(keep + 1);
+        }
+        break;
+    case DepthAction::Change:
+        if (level < count) lv[level] = PriceLevel{price, qty};
+        break;
+    case DepthAction::Delete:
+        if (level < count) {
+            std::memmove(lv + level, lv + level + 1,
+                         (count - level - 1) * sizeof(PriceLevel));
+            lv[--count] = PriceLevel{};
+        }
+        break;
+    }
+    h.last_update_time = ts;
+    h.update_count++;
+
+    h.seq.store(seq + 2, std::memory_order_release);
+}
+
+void DepthCache::clear(uint32_t symbol, uint64_t ts) {
+    reset(symbol, ts, false);
+}
+
+void DepthCache::invalidate(uint32_t symbol, uint64_t ts) {
+    reset(symbol, ts, true);
+}
+
+void DepthCache::reset(uint32_t symbol, uint64_t ts, bool stale) {
+    if (symbol >= num_symbols_) return;
+    BookHeader& h = headers_[symbol];
+    h.stale = stale;
+
+    uint64_t seq = h.seq.load(std::memory_order_relaxed);
+    h.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::fill_n(side_levels(symbol, Side::Bid), 2 * depth_, PriceLevel{});
+    h.levels[0] = h.levels[1] = 0;
+    h.last_update_time = ts;
+    h.update_count++;
+
+    h.seq.store(seq + 2, std::memory_order_release);
+}
+
+// ---- Reader API ----
+bool DepthCache::read_once(uint32_t symbol, DepthSnapshot& out) const {
+    const BookHeader& h = headers_[symbol];
+    uint64_t start = h.seq.load(std::memory_order_acquire);
+    if (start & 1) return false;
+
+    // A torn count is caught by the seq check, but must not overrun first
+    uint32_t nb = std::min<uint32_t>(h.levels[0], uint32_t(depth_));
+    uint32_t na = std::min<uint32_t>(h.levels[1], uint32_t(depth_));
+    std::memcpy(out.bids, side_levels(symbol, Side::Bid), nb * sizeof(PriceLevel));
+    std::memcpy(out.asks, side_levels(symbol, Side::Ask), na * sizeof(PriceLevel));
+    out.bid_levels = nb;
+    out.ask_levels = na;
+    out.last_update_time = h.last_update_time;
+    out.update_count = h.update_count;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return h.seq.load(std::memory_order_relaxed) == start;
+}
+
+bool DepthCache::getDepth(uint32_t symbol, DepthSnapshot& out) const {
+    if (symbol >= num_symbols_) return false;
+    for (unsigned attempt = 0;; ++attempt) {
+        if (read_once(symbol, out)) return true;
+        cache_layout::read_backoff(attempt, SPIN_RETRIES);
+    }
+}
+
+bool DepthCache::tryGetDepth(uint32_t symbol, DepthSnapshot& out,
+                             unsigned max_retries) const {
+    if (symbol >= num_symbols_) return false;
+    for (unsigned attempt = 0; attempt <= max_retries; ++attempt) {
+        if (read_once(symbol, out)) return true;
+        if (attempt < max_retries) cache_layout::read_backoff(attempt, SPIN_RETRIES);
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+// src/common/depth_cache.h
+#pragma once
+#include "protocol.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+struct PriceLevel {
+    double   price = 0;
+    uint32_t qty = 0;
+};
+
+// Reader-side copy of one symbol's book; only the first *_levels entries
+// of each side are meaningful
+struct DepthSnapshot {
+    static constexpr size_t MAX_DEPTH = 20;
+
+    uint32_t bid_levels = 0;
+    uint32_t ask_levels = 0;
+    uint64_t last_update_time = 0;
+    uint64_t update_count = 0;
+    PriceLevel bids[MAX_DEPTH];
+    PriceLevel asks[MAX_DEPTH];
+};
+
+/* ---------------- DepthCache ----------------
+ * Per-symbol L2 price-level book, `depth` levels per side (at most
+ * DepthSnapshot::MAX_DEPTH), kept alongside the top-of-book
+ * LockFreeSymbolCache. Levels live in one flat array, bids then asks for
+ * each symbol, so a book is a few contiguous cache lines and an update is
+ * an indexed store (New/Delete shift at most `depth` entries). Each symbol
+ * has its own seqlock with the same single-writer protocol as
+ * LockFreeSymbolCache, so readers always copy out a whole book.
+ * Updates addressed beyond `depth` are dropped: the book is a truncated
+ * view of a deeper feed.
+ * Level deltas can't repair a book that missed one, so a book with a
+ * lost delta is invalidated: emptied, and deaf to deltas until the next
+ * DepthImage (clear() and New per level) replaces it.
+ */
+class DepthCache {
+public:
+    static constexpr unsigned SPIN_RETRIES = 16;
+    static constexpr unsigned DEFAULT_READ_RETRIES = 64;
+
+    DepthCache(size_t num_symbols, size_t depth);
+
+    size_t size() const { return num_symbols_; }
+    size_t depth() const { return depth_; }
+
+    // Writer API (single thread)
+    void apply(const Tick& tick);   // DepthUpdate/DepthImage; others ignored
+    void applyLevel(uint32_t symbol, Side side, DepthAction action,
+                    uint8_t level, double price, uint32_t qty, uint64_t ts);
+    void clear(uint32_t symbol, uint64_t ts);        // empty, ready for an image
+    void invalidate(uint32_t symbol, uint64_t ts);   // empty until the next image
+
+    // Reader API (lock-free)
+    bool getDepth(uint32_t symbol, DepthSnapshot& out) const;
+    bool tryGetDepth(uint32_t symbol, DepthSnapshot& out,
+                     unsigned max_retries = DEFAULT_READ_RETRIES) const;
+
+private:
+    struct alignas(64) BookHeader {
+        std::atomic<uint64_t> seq{0};
+        uint32_t levels[2]{0, 0};   // indexed by Side
+        uint64_t last_update_time{0};
+        uint64_t update_count{0};
+        bool stale{false};   // writer only: deltas dropped until clear()
+    };
+
+    PriceLevel* side_levels(uint32_t symbol, Side side) {
+        return &levels_[(size_t(symbol) * 2 + size_t(side)) * depth_];
+    }
+    const PriceLevel* side_levels(uint32_t symbol, Side side) const {
+        return &levels_[(size_t(symbol) * 2 + size_t(side)) * depth_];
+    }
+
+    bool read_once(uint32_t symbol, DepthSnapshot& out) const;
+    void reset(uint32_t symbol, uint64_t ts, bool stale);
+
+    size_t num_symbols_;
+    size_t depth_;
+    std::unique_ptr<BookHeader[]> headers_;
+    std::unique_ptr<PriceLevel[]> levels_;
+};
@@ -0,0 +1,158 @@
+// src/common/latency_histogram.h
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/* ---------------- LatencyHistogram ----------------
+ * HDR-style log-linear histogram of nanosecond values. Values below 64 ns
+ * are recorded exactly. Above that, each power of two is split into 64
+ * sub-buckets, which bounds the relative error at 1.6%. Values up to 2^40 ns
+ * (about 18 min) are tracked, and anything larger is clamped. Memory is
+ * fixed: 2240 counters per recording thread.
+ *
+ * Each recording thread gets its own shard, so writers never share a cache
+ * line. A thread that owns its shard outright bumps counters with a relaxed
+ * load and store, which needs no locked instruction. The last shard is
+ * shared by any threads beyond MAX_SHARDS - 1 and uses fetch_add. Readers
+ * merge all shards into a Snapshot. reset() starts a new interval by saving
+ * the current totals as a baseline instead of zeroing live counters, so it
+ * never races with writers.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BITS = 6;
+    static constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS;
+    static constexpr unsigned MAX_BITS = 40;
+    static constexpr uint64_t MAX_VALUE = (uint64_t(1) << MAX_BITS) - 1;
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+    // Threads beyond MAX_SHARDS - 1 share the last shard
+    static constexpr size_t MAX_SHARDS = 16;
+
+    struct Snapshot {
+        std::vector<uint64_t> counts;   // BUCKETS entries
+        uint64_t total{0};
+
+        // Highest value equivalent to the p-th percentile, p in [0, 100]
+        uint64_t percentile(double p) const {
+            if (total == 0) return 0;
+            uint64_t rank = uint64_t(p / 100.0 * double(total) + 0.5);
+            rank = rank == 0 ? 1 : (rank > total ? total : rank);
+
+            uint64_t seen = 0;
+            for (size_t b = 0; b < counts.size(); ++b) {
+                seen += counts[b];
+                if (seen >= rank) return highest_equivalent(b);
+            }
+            return highest_equivalent(counts.size() - 1);
+        }
+
+        uint64_t max() const {
+            for (size_t b = counts.size(); b-- > 0;) {
+                if (counts[b]) return highest_equivalent(b);
+            }
+            return 0;
+        }
+    };
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    ~LatencyHistogram() {
+        for (auto& s : shards_) delete s.load(std::memory_order_relaxed);
+    }
+
+    // Hot path: one relaxed increment on the calling thread's shard
+    void record(uint64_t ns) {
+        size_t slot = thread_slot();
+        Shard* s = shards_[slot].load(std::memory_order_acquire);
+        if (!s) s = add_shard(slot);
+
+        std::atomic<uint64_t>& c = s->counts[bucket_of(ns)];
+        if (slot + 1 < MAX_SHARDS)   // sole writer
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        else
+            c.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counts since the last reset(), merged across threads
+    Snapshot snapshot() const {
+        Snapshot snap = merge();
+        std::lock_guard<std::mutex> lock(baseline_mtx_);
+        if (!baseline_.empty()) {
+            for (size_t b = 0; b < BUCKETS; ++b) snap.counts[b] -= baseline_[b];
+        }
+        snap.total = 0;
+        for (uint64_t c : snap.counts) snap.total += c;
+        return snap;
+    }
+
+    // Start a new reporting interval
+    void reset() {
+        Snapshot now = merge();
+        std::lock_guard<std::mutex> lock(baseline_mtx_);
+        baseline_ = std::move(now.counts);
+    }
+
+    static size_t bucket_of(uint64_t v) {
+        if (v > MAX_VALUE) v = MAX_VALUE;
+        if (v < SUB_COUNT) return size_t(v);
+        unsigned shift = unsigned(63 - __builtin_clzll(v)) - SUB_BITS;
+        return size_t(shift + 1) * SUB_COUNT + size_t((v >> shift) - SUB_COUNT);
+    }
+
+    static uint64_t highest_equivalent(size_t bucket) {
+        uint64_t group = bucket / SUB_COUNT;
+        uint64_t sub = bucket % SUB_COUNT;
+        if (group == 0) return sub;
+        unsigned shift = unsigned(group - 1);
+        return ((SUB_COUNT + sub) << shift) + ((uint64_t(1) << shift) - 1);
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[BUCKETS];
+    };
+
+    static size_t thread_slot() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t slot = [] {
+            size_t s = next.fetch_add(1, std::memory_order_relaxed);
+            return s < MAX_SHARDS ? s : MAX_SHARDS - 1;
+        }();
+        return slot;
+    }
+
+    Shard* add_shard(size_t slot) {
+        Shard* fresh = new Shard();   // value-initialised: all counters zero
+        Shard* expected = nullptr;
+        if (shards_[slot].compare_exchange_strong(expected, fresh,
+                                                  std::memory_order_acq_rel)) {
+            return fresh;
+        }
+        delete fresh;
+        return expected;
+    }
+
+    Snapshot merge() const {
+        Snapshot snap;
+        snap.counts.assign(BUCKETS, 0);
+        for (auto& slot : shards_) {
+            const Shard* s = slot.load(std::memory_order_acquire);
+            if (!s) continue;
+            for (size_t b = 0; b < BUCKETS; ++b)
+                snap.counts[b] += s->counts[b].load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+    std::atomic<Shard*> shards_[MAX_SHARDS]{};
+
+    // Reader side only
+    mutable std::mutex baseline_mtx_;
+    std::vector<uint64_t> baseline_;
+};
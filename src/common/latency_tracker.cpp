@@ -1,37 +1,50 @@
-
-#include <algorithm>
 #include "protocol.h"
 
+const char* latency_stage_name(LatencyStage stage) {
+    switch (stage) {
+    case LatencyStage::ExchangeToKernel: return "exchange->kernel";
+    case LatencyStage::KernelToUser:     return "kernel->user";
+    case LatencyStage::Parse:            return "parse";
+    case LatencyStage::Publish:          return "cache publish";
+    case LatencyStage::EndToEnd:         return "end-to-end";
+    default:                             return "?";
+    }
+}
+
 LatencyTracker& LatencyTracker::instance() {
     static LatencyTracker inst;
     return inst;
 }
 
-void LatencyTracker::record_kernel_to_user(uint64_t ns) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    samples_.push_back(ns);
+void LatencyTracker::record(LatencyStage stage, uint64_t ns) {
+    stages_[size_t(stage)].record(ns);
 }
 
-void LatencyTracker::record_userspace(uint64_t ns) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    samples_.push_back(ns);
+void LatencyTracker::record(const StageTimestamps& ts) {
+    // Skip missing stamps and negative spans (clock skew between hosts)
+    auto span = [this](LatencyStage stage, uint64_t from, uint64_t to) {
+        if (from != 0 && to >= from) stages_[size_t(stage)].record(to - from);
+    };
+
+    span(LatencyStage::ExchangeToKernel, ts.exchange_ns, ts.kernel_rx_ns);
+    span(LatencyStage::KernelToUser, ts.kernel_rx_ns, ts.user_rx_ns);
+    span(LatencyStage::Parse, ts.user_rx_ns, ts.parsed_ns);
+    span(LatencyStage::Publish, ts.parsed_ns, ts.published_ns);
+    span(LatencyStage::EndToEnd, ts.exchange_ns, ts.published_ns);
 }
 
-uint64_t LatencyTracker::p50() const {
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (samples_.empty()) return 0;
+LatencyHistogram::Snapshot LatencyTracker::snapshot(LatencyStage stage) const {
+    return stages_[size_t(stage)].snapshot();
+}
 
-    auto tmp = samples_;
-    std::nth_element(tmp.begin(), tmp.begin() + tmp.size()/2, tmp.end());
-    return tmp[tmp.size()/2];
+void LatencyTracker::reset() {
+    for (auto& h : stages_) h.reset();
 }
 
-uint64_t LatencyTracker::p99() const {
-    std::lock_guard<std::mutex> lock(mtx_);
-    if (samples_.empty()) return 0;
+uint64_t LatencyTracker::p50() const {
+    return snapshot(LatencyStage::EndToEnd).percentile(50);
+}
 
-    auto tmp = samples_;
-    size_t idx = tmp.size() * 99 / 100;
-    std::nth_element(tmp.begin(), tmp.begin() + idx, tmp.end());
-    return tmp[idx];
+uint64_t LatencyTracker::p99() const {
+    return snapshot(LatencyStage::EndToEnd).percentile(99);
 }
@@ -6,10 +6,27 @@
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <ctime>
+#include "latency_histogram.h"
 enum class MsgType : uint16_t {
     Trade = 0x01,
     Quote = 0x02,
-    Heartbeat = 0x03
+    Heartbeat = 0x03,
+    DepthUpdate = 0x04,
+    Snapshot = 0x05,     // full top of book, sent on connect
+    DepthImage = 0x06    // one level of a full L2 book, ahead of its Snapshot
+};
+
+// L2 book side and level operation carried by a DepthUpdate
+enum class Side : uint8_t {
+    Bid = 0,
+    Ask = 1
+};
+
+enum class DepthAction : uint8_t {
+    New = 0,      // insert at level, deeper levels shift down
+    Change = 1,   // overwrite price/qty at level
+    Delete = 2    // remove level, deeper levels shift up
 };
 struct MarketState {
     double   best_bid = 0;
@@ -33,6 +50,13 @@ struct Tick {
     uint32_t ask_qty;            // Best ask quantity
     uint32_t trade_qty;          // Last trade quantity
     uint64_t seq_no;             // Sequence number (strictly increasing)
+
+    // DepthUpdate only: one price level, 0 = best
+    Side depth_side;
+    DepthAction depth_action;
+    uint8_t depth_level;
+    double depth_price;
+    uint32_t depth_qty;
 };
 
 
@@ -51,37 +75,113 @@ private:
 
 
 
+// CLOCK_REALTIME in ns (vDSO, ~20 ns). Exchange timestamps on the wire and
+// kernel SO_TIMESTAMPNS stamps use this clock, so stage deltas line up.
+inline uint64_t wall_clock_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + uint64_t(ts.tv_nsec);
+}
+
+// Where a message is along the wire-to-cache path (wall_clock_ns();
+// 0 = not captured, e.g. no kernel timestamp)
+struct StageTimestamps {
+    uint64_t exchange_ns{0};    // simulator stamped the tick
+    uint64_t kernel_rx_ns{0};   // kernel RX stamp of the recvmsg that returned it
+    uint64_t user_rx_ns{0};     // recvmsg returned to user space
+    uint64_t parsed_ns{0};      // parser handed the tick out
+    uint64_t published_ns{0};   // cache update finished
+};
+
+enum class LatencyStage : uint8_t {
+    ExchangeToKernel,   // generation, batching, server send, network
+    KernelToUser,       // socket queue + recvmsg
+    Parse,              // framing/checksum/decode, incl. earlier msgs in the read
+    Publish,            // cache update
+    EndToEnd,           // exchange -> cache
+    Count
+};
+
+const char* latency_stage_name(LatencyStage stage);
+
 class LatencyTracker {
 public:
     static LatencyTracker& instance();
-    void record_kernel_to_user(uint64_t ns);
-     void record_userspace(uint64_t ns);   // Add This
+
+    // One message: records every stage whose endpoints were captured
+    void record(const StageTimestamps& ts);
+    void record(LatencyStage stage, uint64_t ns);
+
+    // End-to-end percentiles
     uint64_t p50() const;
     uint64_t p99() const;
 
+    // Everything recorded since the last reset(), for multi-percentile reports
+    LatencyHistogram::Snapshot snapshot(LatencyStage stage) const;
+    void reset();
+
 private:
     LatencyTracker() = default;
 
-    mutable std::mutex mtx_;
-    std::vector<uint64_t> samples_;
+    LatencyHistogram stages_[size_t(LatencyStage::Count)];
     // std::vector<uint64_t> samples_;
 };
 
 class LockFreeSymbolCache {
 public:
-    explicit LockFreeSymbolCache(size_t num_symbols);
+    // With shm_name (e.g. "/md_cache") the slots live in a POSIX shared
+    // memory segment that shm_cache_reader can attach to read-only. If the
+    // segment cannot be created the cache falls back to process memory;
+    // check shared().
+    explicit LockFreeSymbolCache(size_t num_symbols, const char* shm_name = nullptr);
       ~LockFreeSymbolCache();
 
     size_t size() const;   // ✅ declaration only
+    bool shared() const;
 
     // Writer API (single thread)
     void updateBid(uint32_t symbol, double price, uint32_t qty, uint64_t ts);
     void updateAsk(uint32_t symbol, double price, uint32_t qty, uint64_t ts);
     void updateTrade(uint32_t symbol, double price, uint32_t qty, uint64_t ts);
 
+    // Whole-message writes: bid and ask (or the trade) land in one seqlock
+    // section, so readers never see half a quote. Heartbeats are ignored.
+    void applyQuote(const Tick& tick);
+    void applyTrade(const Tick& tick);
+    void applySnapshot(const Tick& tick);   // every top-of-book field
+    void applyBatch(const Tick* ticks, size_t n);
+
     // Reader API (lock-free)
+    // Retries are paused with cpu_relax() for SPIN_RETRIES attempts, then yield.
+    static constexpr unsigned SPIN_RETRIES = 16;
+    static constexpr unsigned DEFAULT_READ_RETRIES = 64;
+
+    struct ReaderStats {
+        uint64_t retries;    // torn or in-progress reads that were retried
+        uint64_t failures;   // bounded reads that gave up
+    };
+
+    // Blocks until a consistent copy is read
     bool getSnapshot(uint32_t symbol, MarketState& out) const;
 
+    // Gives up after max_retries failed attempts and returns false
+    bool tryGetSnapshot(uint32_t symbol, MarketState& out,
+                        unsigned max_retries = DEFAULT_READ_RETRIES) const;
+
+    // Bounded read of ids[0..n) into out[0..n). Entries that could not be
+    // read are zeroed. Returns the number read consistently.
+    size_t getSnapshots(const uint32_t* ids, size_t n, MarketState* out,
+                        unsigned max_retries = DEFAULT_READ_RETRIES) const;
+
+    ReaderStats readerStats() const;
+
+    // Change tracking: every write advances epoch(). changedSince(E, ids)
+    // lists the symbols written after epoch E and returns the epoch to pass
+    // next time. Cost follows the number of active 64-symbol blocks.
+    uint64_t epoch() const;
+    uint64_t symbolEpoch(uint32_t symbol) const;
+    uint64_t changedSince(uint64_t since, std::vector<uint32_t>& out) const;
+
 private:
     // std::vector<AtomicMarketState> symbols_;
     // private:
@@ -0,0 +1,220 @@
+// src/common/ring_buffer.h
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* ---------------- SpscByteRing ----------------
+ * Single-producer / single-consumer byte ring.
+ * Capacity is rounded up to a power of two; head/tail are free-running
+ * counters so `tail - head` is always the number of buffered bytes.
+ * Storage is left uninitialised so untouched pages are never committed.
+ */
+class SpscByteRing {
+public:
+    explicit SpscByteRing(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        capacity_ = cap;
+        mask_ = cap - 1;
+        buf_.reset(new uint8_t[cap]);
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) -
+               head_.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    size_t free_space() const { return capacity_ - size(); }
+
+    // ---- Producer ----
+    // All-or-nothing: returns false (and writes nothing) if `len` won't fit.
+    bool write(const void* data, size_t len) {
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        uint64_t head = head_.load(std::memory_order_acquire);
+        if (capacity_ - (tail - head) < len) return false;
+
+        size_t off = tail & mask_;
+        size_t first = std::min(len, capacity_ - off);
+        std::memcpy(buf_.get() + off, data, first);
+        std::memcpy(buf_.get(), static_cast<const uint8_t*>(data) + first,
+                    len - first);
+
+        tail_.store(tail + len, std::memory_order_release);
+        return true;
+    }
+
+    // ---- Consumer ----
+    // Up to two contiguous readable regions (second is non-empty on wrap).
+    size_t peek(const uint8_t*& p1, size_t& n1,
+                const uint8_t*& p2, size_t& n2) const {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        size_t avail = tail - head;
+        size_t off = head & mask_;
+
+        p1 = buf_.get() + off;
+        n1 = std::min(avail, capacity_ - off);
+        p2 = buf_.get();
+        n2 = avail - n1;
+        return avail;
+    }
+
+    void consume(size_t n) {
+        head_.store(head_.load(std::memory_order_relaxed) + n,
+                    std::memory_order_release);
+    }
+
+private:
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<uint8_t[]> buf_;
+
+    alignas(64) std::atomic<uint64_t> head_{0};   // consumer
+    alignas(64) std::atomic<uint64_t> tail_{0};   // producer
+};
+
+/* ---------------- BroadcastRing ----------------
+ * Single-producer / multi-consumer ring of fixed-size slots.
+ * Every consumer sees every slot: each one owns a cursor, and the producer
+ * only reuses a slot once the slowest cursor has moved past it.
+ * Neither side takes a lock; the producer spins (yielding) when full.
+ */
+class BroadcastRing {
+public:
+    BroadcastRing(size_t slots, size_t slot_bytes, size_t consumers)
+        : slot_bytes_(slot_bytes),
+          cursors_(new Cursor[consumers]),
+          num_consumers_(consumers) {
+        size_t cap = 1;
+        while (cap < slots) cap <<= 1;
+        mask_ = cap - 1;
+        lens_.reset(new size_t[cap]);
+        data_.reset(new uint8_t[cap * slot_bytes_]);
+    }
+
+    size_t slot_bytes() const { return slot_bytes_; }
+
+    // ---- Producer ----
+    // `len` must not exceed slot_bytes(); `idle` is called while waiting
+    // for the slowest consumer to free a slot.
+    template <typename Idle>
+    void publish(const void* data, size_t len, Idle&& idle) {
+        uint64_t seq = published_.load(std::memory_order_relaxed);
+        while (seq - min_cursor() > mask_) idle();
+
+        size_t slot = seq & mask_;
+        std::memcpy(data_.get() + slot * slot_bytes_, data, len);
+        lens_[slot] = len;
+        published_.store(seq + 1, std::memory_order_release);
+    }
+
+    // ---- Consumer (ids 0 .. consumers-1) ----
+    // Next unread slot for `consumer`, or nullptr if it is caught up.
+    const uint8_t* peek(size_t consumer, size_t& len) const {
+        uint64_t pos = cursors_[consumer].pos.load(std::memory_order_relaxed);
+        if (pos == published_.load(std::memory_order_acquire)) return nullptr;
+        size_t slot = pos & mask_;
+        len = lens_[slot];
+        return data_.get() + slot * slot_bytes_;
+    }
+
+    void advance(size_t consumer) {
+        auto& c = cursors_[consumer].pos;
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    struct alignas(64) Cursor {
+        std::atomic<uint64_t> pos{0};
+    };
+
+    uint64_t min_cursor() const {
+        uint64_t m = published_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < num_consumers_; ++i)
+            m = std::min(m, cursors_[i].pos.load(std::memory_order_acquire));
+        return m;
+    }
+
+    size_t mask_;
+    size_t slot_bytes_;
+    std::unique_ptr<size_t[]> lens_;
+    std::unique_ptr<uint8_t[]> data_;
+    std::unique_ptr<Cursor[]> cursors_;
+    size_t num_consumers_;
+
+    alignas(64) std::atomic<uint64_t> published_{0};
+};
+
+/* ---------------- MirroredByteRing ----------------
+ * Single-threaded byte ring whose pages are mapped twice, back to back
+ * (memfd + two MAP_FIXED views). Any run of up to capacity() bytes starting
+ * anywhere in the ring is contiguous in memory, so data is received
+ * straight into write_ptr() and parsed straight out of read_ptr(). Frames
+ * that wrap need no copy, and nothing is ever compacted.
+ * Capacity is rounded up to a power-of-two number of pages. Check valid():
+ * the mapping fails without memfd_create (Linux < 3.17).
+ */
+class MirroredByteRing {
+public:
+    explicit MirroredByteRing(size_t capacity) {
+        size_t cap = size_t(sysconf(_SC_PAGESIZE));
+        while (cap < capacity) cap <<= 1;
+
+        int fd = memfd_create("mirrored_ring", 0);
+        if (fd < 0) return;
+        if (ftruncate(fd, cap) == 0) {
+            // Reserve 2x address space, then map the same pages into both halves
+            void* base = mmap(nullptr, 2 * cap, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base != MAP_FAILED) {
+                uint8_t* b = static_cast<uint8_t*>(base);
+                if (mmap(b, cap, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                    mmap(b + cap, cap, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED) {
+                    base_ = b;
+                    capacity_ = cap;
+                } else {
+                    munmap(base, 2 * cap);
+                }
+            }
+        }
+        close(fd);   // the mappings keep the memory alive
+    }
+
+    ~MirroredByteRing() {
+        if (base_) munmap(base_, 2 * capacity_);
+    }
+
+    MirroredByteRing(const MirroredByteRing&) = delete;
+    MirroredByteRing& operator=(const MirroredByteRing&) = delete;
+
+    bool valid() const { return base_ != nullptr; }
+    size_t capacity() const { return capacity_; }
+
+    size_t size() const { return size_t(tail_ - head_); }
+    void clear() { head_ = tail_ = 0; }
+
+    // Producer: free_space() contiguous bytes at write_ptr()
+    uint8_t* write_ptr() { return base_ + (tail_ & (capacity_ - 1)); }
+    size_t free_space() const { return capacity_ - size(); }
+    void commit(size_t n) { tail_ += n; }
+
+    // Consumer: size() contiguous bytes at read_ptr()
+    const uint8_t* read_ptr() const { return base_ + (head_ & (capacity_ - 1)); }
+    void consume(size_t n) { head_ += n; }
+
+private:
+    uint8_t* base_{nullptr};
+    size_t capacity_{0};
+    uint64_t head_{0};
+    uint64_t tail_{0};
+};
@@ -0,0 +1,111 @@
+// src/common/shm_cache_reader.cpp
+#include "shm_cache_reader.h"
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+SharedCacheReader::SharedCacheReader(const char* shm_name) {
+    int fd = shm_open(shm_name, O_RDONLY, 0);
+    if (fd < 0) {
+        error_ = "no such segment";
+        return;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(cache_layout::Header)) {
+        close(fd);
+        error_ = "segment too small";
+        return;
+    }
+
+    size_t len = size_t(st.st_size);
+    void* p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);   // the mapping keeps the segment alive
+    if (p == MAP_FAILED) {
+        error_ = "mmap failed";
+        return;
+    }
+    map_ = p;
+    map_len_ = len;
+
+    const auto* hdr = static_cast<const cache_layout::Header*>(p);
+    if (hdr->magic.load(std::memory_order_acquire) != cache_layout::MAGIC) {
+        error_ = "segment not initialised";
+        return;
+    }
+    if (hdr->version != cache_layout::LAYOUT_VERSION) {
+        error_ = "layout version mismatch";
+        return;
+    }
+    size_t n = hdr->num_symbols;
+    if (hdr->header_size < sizeof(cache_layout::Header) ||
+        hdr->slot_size != sizeof(AtomicMarketState) ||
+        hdr->header_size + n * hdr->slot_size > hdr->symbol_epochs_offset ||
+        hdr->symbol_epochs_offset + n * sizeof(uint64_t) > hdr->block_epochs_offset ||
+        hdr->block_epochs_offset + cache_layout::epoch_blocks(n) * sizeof(uint64_t) > len) {
+        error_ = "layout size mismatch";
+        return;
+    }
+
+    version_ = hdr->version;
+    writer_pid_ = hdr->writer_pid;
+    num_symbols_ = hdr->num_symbols;
+    const uint8_t* base = static_cast<const uint8_t*>(p);
+    epoch_ = &hdr->epoch;
+    symbol_epochs_ = reinterpret_cast<const std::atomic<uint64_t>*>(
+        base + hdr->symbol_epochs_offset);
+    block_epochs_ = reinterpret_cast<const std::atomic<uint64_t>*>(
+        base + hdr->block_epochs_offset);
+    slots_ = reinterpret_cast<const AtomicMarketState*>(base + hdr->header_size);
+}
+
+SharedCacheReader::~SharedCacheReader() {
+    if (map_) munmap(const_cast<void*>(map_), map_len_);
+}
+
+bool SharedCacheReader::writer_alive() const {
+    if (!valid()) return false;
+    return kill(pid_t(writer_pid_), 0) == 0 || errno == EPERM;
+}
+
+bool SharedCacheReader::getSnapshot(uint32_t symbol, MarketState& out) const {
+    if (symbol >= num_symbols_) return false;
+    const AtomicMarketState& s = slots_[symbol];
+
+    for (unsigned attempt = 0;; ++attempt) {
+        if (cache_layout::read_once(s, out)) {
+            if (attempt) retries_.fetch_add(attempt, std::memory_order_relaxed);
+            return true;
+        }
+        cache_layout::read_backoff(attempt, SPIN_RETRIES);
+    }
+}
+
+bool SharedCacheReader::tryGetSnapshot(uint32_t symbol, MarketState& out,
+                                       unsigned max_retries) const {
+    if (symbol >= num_symbols_) return false;
+
+    unsigned retries = 0;
+    bool ok = cache_layout::read_bounded(slots_[symbol], out, max_retries,
+                                         SPIN_RETRIES, retries);
+    if (retries) retries_.fetch_add(retries, std::memory_order_relaxed);
+    if (!ok) failures_.fetch_add(1, std::memory_order_relaxed);
+    return ok;
+}
+
+size_t SharedCacheReader::getSnapshots(const uint32_t* ids, size_t n,
+                                       MarketState* out,
+                                       unsigned max_retries) const {
+    size_t ok = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (i + 4 < n && ids[i + 4] < num_symbols_)
+            __builtin_prefetch(&slots_[ids[i + 4]]);
+
+        if (tryGetSnapshot(ids[i], out[i], max_retries)) ++ok;
+        else out[i] = MarketState{};
+    }
+    return ok;
+}
@@ -0,0 +1,76 @@
+// src/common/shm_cache_reader.h
+#pragma once
+#include "cache_layout.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* ---------------- SharedCacheReader ----------------
+ * Read-only view of a LockFreeSymbolCache exported by another process
+ * (feed_handler --shm NAME). Attaches with shm_open + mmap(PROT_READ) and
+ * reads slots with the same seqlock protocol as the in-process cache, so
+ * any number of strategy processes share one feed with zero copies.
+ * Check valid() after construction; error() says why attaching failed.
+ * A reader is cheap: give each thread its own, or share one (all reads
+ * are const and the counters are atomic).
+ */
+class SharedCacheReader {
+public:
+    static constexpr unsigned SPIN_RETRIES = 16;
+    static constexpr unsigned DEFAULT_READ_RETRIES = 64;
+
+    struct ReaderStats {
+        uint64_t retries;    // torn or in-progress reads that were retried
+        uint64_t failures;   // bounded reads that gave up
+    };
+
+    explicit SharedCacheReader(const char* shm_name);
+    ~SharedCacheReader();
+
+    SharedCacheReader(const SharedCacheReader&) = delete;
+    SharedCacheReader& operator=(const SharedCacheReader&) = delete;
+
+    bool valid() const { return slots_ != nullptr; }
+    const char* error() const { return error_; }
+
+    size_t size() const { return num_symbols_; }
+    uint32_t layout_version() const { return version_; }
+
+    // False once the exporting process has exited; the data is then frozen
+    bool writer_alive() const;
+
+    // Same contracts as LockFreeSymbolCache; ids outside size() fail
+    bool getSnapshot(uint32_t symbol, MarketState& out) const;
+    bool tryGetSnapshot(uint32_t symbol, MarketState& out,
+                        unsigned max_retries = DEFAULT_READ_RETRIES) const;
+    size_t getSnapshots(const uint32_t* ids, size_t n, MarketState* out,
+                        unsigned max_retries = DEFAULT_READ_RETRIES) const;
+
+    // Change tracking, as LockFreeSymbolCache::changedSince
+    uint64_t epoch() const { return epoch_->load(std::memory_order_acquire); }
+    uint64_t changedSince(uint64_t since, std::vector<uint32_t>& out) const {
+        return cache_layout::changed_since(*epoch_, symbol_epochs_, block_epochs_,
+                                           num_symbols_, since, out);
+    }
+
+    ReaderStats readerStats() const {
+        return {retries_.load(std::memory_order_relaxed),
+                failures_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    const void* map_{nullptr};
+    size_t map_len_{0};
+    const AtomicMarketState* slots_{nullptr};
+    const std::atomic<uint64_t>* epoch_{nullptr};
+    const std::atomic<uint64_t>* symbol_epochs_{nullptr};
+    const std::atomic<uint64_t>* block_epochs_{nullptr};
+    size_t num_symbols_{0};
+    uint32_t version_{0};
+    uint64_t writer_pid_{0};
+    const char* error_{nullptr};
+
+    mutable std::atomic<uint64_t> retries_{0};
+    mutable std::atomic<uint64_t> failures_{0};
+};
@@ -0,0 +1,67 @@
+// src/common/tsc_clock.h
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* ---------------- TscClock ----------------
+ * Nanosecond clock read from the CPU timestamp counter, calibrated once
+ * against steady_clock. Needs an invariant TSC (constant_tsc/nonstop_tsc in
+ * /proc/cpuinfo); other architectures fall back to steady_clock.
+ * Meant for pacing and short intervals: the 20 ms calibration drifts by
+ * microseconds per minute, so timestamps that are compared across
+ * processes come from wall_clock_ns() (protocol.h) instead.
+ */
+class TscClock {
+public:
+    static const TscClock& instance() {
+        static TscClock clock;
+        return clock;
+    }
+
+    static uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+
+    // Monotonic ns (steady_clock epoch)
+    uint64_t now_ns() const {
+        return base_ns_ + uint64_t(double(ticks() - base_ticks_) * ns_per_tick_);
+    }
+
+    double ns_per_tick() const { return ns_per_tick_; }
+
+private:
+    TscClock() {
+        using namespace std::chrono;
+        auto steady_ns = [] {
+            return uint64_t(duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count());
+        };
+
+        uint64_t t0 = ticks(), n0 = steady_ns();
+        std::this_thread::sleep_for(milliseconds(20));
+        uint64_t t1 = ticks(), n1 = steady_ns();
+
+        ns_per_tick_ = (t1 > t0) ? double(n1 - n0) / double(t1 - t0) : 1.0;
+        base_ticks_ = t1;
+        base_ns_ = n1;
+    }
+
+    uint64_t base_ticks_;
+    uint64_t base_ns_;
+    double ns_per_tick_;
+};
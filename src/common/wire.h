@@ -0,0 +1,390 @@
+// src/common/wire.h
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include "protocol.h"  // for Tick, MsgType
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* ---------------- Wire layout (single source of truth) ----------------
+ *
+ * Every frame is packed, little-endian, with no padding:
+ *
+ *   offset  size  field
+ *   ------  ----  -----------------------------
+ *        0     2  type       (MsgType)
+ *        2     4  seq        (per-symbol sequence number)
+ *        6     8  timestamp  (ns since epoch)
+ *       14     2  symbol_id
+ *       16     N  payload    (see below)
+ *   16 + N     4  checksum   (XOR of all preceding bytes)
+ *
+ *   Trade     : price f64, qty u32                        -> N = 12
+ *   Quote     : bid f64, bid_qty u32, ask f64, ask_qty u32 -> N = 24
+ *   Heartbeat : (empty)                                   -> N = 0
+ *   Depth     : side u8, action u8, level u8, price f64,
+ *               qty u32                                   -> N = 15
+ *   Snapshot  : bid f64, bid_qty u32, ask f64, ask_qty u32,
+ *               last f64, last_qty u32                    -> N = 36
+ *   DepthImage: same payload as Depth, action always New  -> N = 15
+ *
+ * A Snapshot carries a symbol's whole top of book as of its `seq`, with
+ * `timestamp` = the symbol's last update. The server sends one per symbol
+ * to each new connection before any live data. When the feed has depth,
+ * each Snapshot is preceded by its symbol's L2 book as DepthImage frames
+ * with the same `seq`, bids then asks, best level first. The client
+ * replaces its book with the image when it applies the Snapshot.
+ *
+ * Both the exchange simulator (encode) and MarketDataParser (decode)
+ * go through these helpers, so the two sides cannot drift apart.
+ * ---------------------------------------------------------------------- */
+
+namespace wire {
+
+constexpr size_t HEADER_SIZE   = 16;
+constexpr size_t CHECKSUM_SIZE = 4;
+
+constexpr size_t TRADE_PAYLOAD_SIZE     = 12;
+constexpr size_t QUOTE_PAYLOAD_SIZE     = 24;
+constexpr size_t HEARTBEAT_PAYLOAD_SIZE = 0;
+constexpr size_t DEPTH_PAYLOAD_SIZE     = 15;
+constexpr size_t SNAPSHOT_PAYLOAD_SIZE  = 36;
+
+constexpr size_t TRADE_FRAME_SIZE =
+    HEADER_SIZE + TRADE_PAYLOAD_SIZE + CHECKSUM_SIZE;
+constexpr size_t QUOTE_FRAME_SIZE =
+    HEADER_SIZE + QUOTE_PAYLOAD_SIZE + CHECKSUM_SIZE;
+constexpr size_t HEARTBEAT_FRAME_SIZE =
+    HEADER_SIZE + HEARTBEAT_PAYLOAD_SIZE + CHECKSUM_SIZE;
+constexpr size_t DEPTH_FRAME_SIZE =
+    HEADER_SIZE + DEPTH_PAYLOAD_SIZE + CHECKSUM_SIZE;
+constexpr size_t SNAPSHOT_FRAME_SIZE =
+    HEADER_SIZE + SNAPSHOT_PAYLOAD_SIZE + CHECKSUM_SIZE;
+
+constexpr size_t MIN_FRAME_SIZE = HEARTBEAT_FRAME_SIZE;
+constexpr size_t MAX_FRAME_SIZE = SNAPSHOT_FRAME_SIZE;
+
+struct FrameHeader {
+    uint16_t type;
+    uint32_t seq;
+    uint64_t timestamp_ns;
+    uint16_t symbol_id;
+};
+
+// Payload size for a message type, or -1 if the type is unknown.
+inline ptrdiff_t payload_size(uint16_t type) {
+    switch (static_cast<MsgType>(type)) {
+    case MsgType::Trade:     return TRADE_PAYLOAD_SIZE;
+    case MsgType::Quote:     return QUOTE_PAYLOAD_SIZE;
+    case MsgType::Heartbeat: return HEARTBEAT_PAYLOAD_SIZE;
+    case MsgType::DepthUpdate: return DEPTH_PAYLOAD_SIZE;
+    case MsgType::Snapshot:  return SNAPSHOT_PAYLOAD_SIZE;
+    case MsgType::DepthImage: return DEPTH_PAYLOAD_SIZE;
+    }
+    return -1;
+}
+
+// Total frame length for a message type, or 0 if the type is unknown.
+inline size_t frame_size(uint16_t type) {
+    ptrdiff_t n = payload_size(type);
+    return n < 0 ? 0 : HEADER_SIZE + n + CHECKSUM_SIZE;
+}
+
+// XOR of all bytes, widened to u32. XOR is associative, so the bytes are
+// folded a vector (or a word) at a time and the lanes reduced at the end.
+inline uint32_t checksum(const uint8_t* data, size_t len) {
+    size_t i = 0;
+    uint64_t x = 0;
+
+#if defined(__AVX2__)
+    if (len >= 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 32 <= len; i += 32)
+            acc = _mm256_xor_si256(acc, _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i)));
+        __m128i half = _mm_xor_si128(_mm256_castsi256_si128(acc),
+                                     _mm256_extracti128_si256(acc, 1));
+        half = _mm_xor_si128(half, _mm_srli_si128(half, 8));
+        x ^= uint64_t(_mm_cvtsi128_si64(half));
+    }
+#endif
+#if defined(__SSE2__)
+    if (len - i >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= len; i += 16)
+            acc = _mm_xor_si128(acc, _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i)));
+        acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+        x ^= uint64_t(_mm_cvtsi128_si64(acc));
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        x ^= w;
+    }
+    for (; i < len; ++i)
+        x ^= data[i];
+
+    x ^= x >> 32;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    return uint32_t(x & 0xff);
+}
+
+// ---- Encoder (zero allocation, writes straight into caller's buffer) ----
+
+inline void put_header(uint8_t* out, uint16_t type, uint32_t seq,
+                       uint64_t ts, uint16_t sym) {
+    std::memcpy(out,      &type, 2);
+    std::memcpy(out + 2,  &seq,  4);
+    std::memcpy(out + 6,  &ts,   8);
+    std::memcpy(out + 14, &sym,  2);
+}
+
+inline size_t seal(uint8_t* frame, size_t body_len) {
+    uint32_t sum = checksum(frame, body_len);
+    std::memcpy(frame + body_len, &sum, CHECKSUM_SIZE);
+    return body_len + CHECKSUM_SIZE;
+}
+
+inline size_t encode_trade(uint8_t* out, uint32_t seq, uint64_t ts,
+                           uint16_t sym, double price, uint32_t qty) {
+    put_header(out, static_cast<uint16_t>(MsgType::Trade), seq, ts, sym);
+    uint8_t* p = out + HEADER_SIZE;
+    std::memcpy(p,     &price, 8);
+    std::memcpy(p + 8, &qty,   4);
+    return seal(out, HEADER_SIZE + TRADE_PAYLOAD_SIZE);
+}
+
+inline size_t encode_quote(uint8_t* out, uint32_t seq, uint64_t ts,
+                           uint16_t sym,
+                           double bid, uint32_t bid_qty,
+                           double ask, uint32_t ask_qty) {
+    put_header(out, static_cast<uint16_t>(MsgType::Quote), seq, ts, sym);
+    uint8_t* p = out + HEADER_SIZE;
+    std::memcpy(p,      &bid,     8);
+    std::memcpy(p + 8,  &bid_qty, 4);
+    std::memcpy(p + 12, &ask,     8);
+    std::memcpy(p + 20, &ask_qty, 4);
+    return seal(out, HEADER_SIZE + QUOTE_PAYLOAD_SIZE);
+}
+
+inline size_t encode_depth(uint8_t* out, uint32_t seq, uint64_t ts,
+                           uint16_t sym, Side side, DepthAction action,
+                           uint8_t level, double price, uint32_t qty,
+                           MsgType type = MsgType::DepthUpdate) {
+    put_header(out, static_cast<uint16_t>(type), seq, ts, sym);
+    uint8_t* p = out + HEADER_SIZE;
+    p[0] = static_cast<uint8_t>(side);
+    p[1] = static_cast<uint8_t>(action);
+    p[2] = level;
+    std::memcpy(p + 3,  &price, 8);
+    std::memcpy(p + 11, &qty,   4);
+    return seal(out, HEADER_SIZE + DEPTH_PAYLOAD_SIZE);
+}
+
+inline size_t encode_snapshot(uint8_t* out, uint32_t seq, uint64_t ts,
+                              uint16_t sym,
+                              double bid, uint32_t bid_qty,
+                              double ask, uint32_t ask_qty,
+                              double last, uint32_t last_qty) {
+    put_header(out, static_cast<uint16_t>(MsgType::Snapshot), seq, ts, sym);
+    uint8_t* p = out + HEADER_SIZE;
+    std::memcpy(p,      &bid,      8);
+    std::memcpy(p + 8,  &bid_qty,  4);
+    std::memcpy(p + 12, &ask,      8);
+    std::memcpy(p + 20, &ask_qty,  4);
+    std::memcpy(p + 24, &last,     8);
+    std::memcpy(p + 32, &last_qty, 4);
+    return seal(out, HEADER_SIZE + SNAPSHOT_PAYLOAD_SIZE);
+}
+
+inline size_t encode_heartbeat(uint8_t* out, uint32_t seq, uint64_t ts) {
+    put_header(out, static_cast<uint16_t>(MsgType::Heartbeat), seq, ts, 0);
+    return seal(out, HEADER_SIZE);
+}
+
+// Encode a generated tick. `out` must have room for MAX_FRAME_SIZE bytes.
+// Returns the number of bytes written.
+inline size_t encode(const Tick& t, uint8_t* out) {
+    switch (t.type) {
+    case MsgType::Trade:
+        return encode_trade(out, static_cast<uint32_t>(t.seq_no),
+                            t.timestamp_ns,
+                            static_cast<uint16_t>(t.symbol_id),
+                            t.last_trade_price, t.trade_qty);
+    case MsgType::Quote:
+        return encode_quote(out, static_cast<uint32_t>(t.seq_no),
+                            t.timestamp_ns,
+                            static_cast<uint16_t>(t.symbol_id),
+                            t.bid_price, t.bid_qty,
+                            t.ask_price, t.ask_qty);
+    case MsgType::Heartbeat:
+        return encode_heartbeat(out, static_cast<uint32_t>(t.seq_no),
+                                t.timestamp_ns);
+    case MsgType::DepthUpdate:
+    case MsgType::DepthImage:
+        return encode_depth(out, static_cast<uint32_t>(t.seq_no),
+                            t.timestamp_ns,
+                            static_cast<uint16_t>(t.symbol_id),
+                            t.depth_side, t.depth_action, t.depth_level,
+                            t.depth_price, t.depth_qty, t.type);
+    case MsgType::Snapshot:
+        return encode_snapshot(out, static_cast<uint32_t>(t.seq_no),
+                               t.timestamp_ns,
+                               static_cast<uint16_t>(t.symbol_id),
+                               t.bid_price, t.bid_qty,
+                               t.ask_price, t.ask_qty,
+                               t.last_trade_price, t.trade_qty);
+    }
+    return 0;
+}
+
+// ---- Client -> server requests ----
+//
+//   Subscribe : 0xFF, count u16, count x symbol_id u16
+//               Replaces the client's subscription; count = 0 restores
+//               the full feed.
+//   Retransmit: 0xFE, symbol_id u16, from u32, to u32
+//               Resend the symbol's frames with from <= seq <= to that the
+//               server still holds, in seq order, ahead of any further
+//               live data. If it no longer holds the start of the range,
+//               or is conflating the client, the symbol's snapshot
+//               (DepthImage + Snapshot frames) follows or replaces them.
+
+constexpr uint8_t SUBSCRIBE_REQUEST = 0xFF;
+constexpr size_t SUBSCRIBE_HEADER_SIZE = 3;
+
+constexpr uint8_t RETRANSMIT_REQUEST = 0xFE;
+constexpr size_t RETRANSMIT_REQUEST_SIZE = 11;
+
+inline size_t encode_retransmit_request(uint8_t* out, uint16_t sym,
+                                        uint32_t from, uint32_t to) {
+    out[0] = RETRANSMIT_REQUEST;
+    std::memcpy(out + 1, &sym,  2);
+    std::memcpy(out + 3, &from, 4);
+    std::memcpy(out + 7, &to,   4);
+    return RETRANSMIT_REQUEST_SIZE;
+}
+
+// ---- Decoder ----
+
+inline FrameHeader read_header(const uint8_t* p) {
+    FrameHeader h;
+    std::memcpy(&h.type,         p,      2);
+    std::memcpy(&h.seq,          p + 2,  4);
+    std::memcpy(&h.timestamp_ns, p + 6,  8);
+    std::memcpy(&h.symbol_id,    p + 14, 2);
+    return h;
+}
+
+inline bool verify(const uint8_t* frame, size_t frame_len) {
+    uint32_t expected;
+    std::memcpy(&expected, frame + frame_len - CHECKSUM_SIZE, CHECKSUM_SIZE);
+    return checksum(frame, frame_len - CHECKSUM_SIZE) == expected;
+}
+
+// ---- Resync ----
+//
+// After a bad frame, find the next offset in [data, data + len) where a
+// frame could start: a known type whose whole frame is present and
+// verifies, or a known type whose frame runs past `len` (undecidable until
+// more bytes arrive). Fewer than MIN_FRAME_SIZE bytes left also count as
+// undecidable. Returns that offset, which is `len` only when len == 0.
+//
+// Candidates are found 16 positions at a time (type low byte in
+// 1..MAX_TYPE, high byte 0). Each one is checked in O(1) against a prefix
+// XOR of the block, P[i] = d[0] ^ ... ^ d[i-1], so the checksum of
+// [s, e) is P[e] ^ P[s]. No byte is ever XORed more than once.
+
+constexpr uint8_t MAX_TYPE = static_cast<uint8_t>(MsgType::DepthImage);
+
+inline size_t scan_for_frame(const uint8_t* data, size_t len) {
+    constexpr size_t BLOCK = 1024;
+    uint8_t prefix[BLOCK + MAX_FRAME_SIZE + 1];
+
+    // Only positions with a full header's worth left can be rejected
+    const size_t last = len >= MIN_FRAME_SIZE ? len - MIN_FRAME_SIZE + 1 : 0;
+
+    for (size_t base = 0; base < last; base += BLOCK) {
+        size_t end = std::min(last, base + BLOCK);          // candidates
+        size_t span = std::min(len, end + MAX_FRAME_SIZE) - base;
+
+        prefix[0] = 0;
+        for (size_t i = 0; i < span; ++i)
+            prefix[i + 1] = prefix[i] ^ data[base + i];
+
+        auto check = [&](size_t s) -> bool {
+            size_t flen = frame_size(uint16_t(data[s]) | uint16_t(data[s + 1]) << 8);
+            if (flen == 0) return false;
+            if (s + flen > len) return true;                // can't judge yet
+            uint32_t stored;
+            std::memcpy(&stored, data + s + flen - CHECKSUM_SIZE, CHECKSUM_SIZE);
+            size_t r = s - base;
+            return stored == uint32_t(prefix[r + flen - CHECKSUM_SIZE] ^ prefix[r]);
+        };
+
+        size_t s = base;
+#if defined(__SSE2__)
+        const __m128i one = _mm_set1_epi8(1);
+        const __m128i top = _mm_set1_epi8(char(MAX_TYPE - 1));
+        const __m128i zero = _mm_setzero_si128();
+        for (; s + 16 <= end && s + 17 <= len; s += 16) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + s));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + s + 1));
+            __m128i t = _mm_sub_epi8(lo, one);               // 1..MAX -> 0..MAX-1
+            __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(t, top), t);
+            unsigned mask = unsigned(_mm_movemask_epi8(
+                _mm_and_si128(in_range, _mm_cmpeq_epi8(hi, zero))));
+            while (mask) {
+                size_t c = s + size_t(__builtin_ctz(mask));
+                if (check(c)) return c;
+                mask &= mask - 1;
+            }
+        }
+#endif
+        for (; s < end; ++s) {
+            if (check(s)) return s;
+        }
+    }
+    return last;
+}
+
+// Fill a Tick from a frame whose header and checksum were already checked.
+inline void decode(const FrameHeader& h, const uint8_t* frame, Tick& tick) {
+    tick.type = static_cast<MsgType>(h.type);
+    tick.timestamp_ns = h.timestamp_ns;
+    tick.symbol_id = h.symbol_id;
+    tick.seq_no = h.seq;
+
+    const uint8_t* p = frame + HEADER_SIZE;
+    if (tick.type == MsgType::Trade) {
+        std::memcpy(&tick.last_trade_price, p,     8);
+        std::memcpy(&tick.trade_qty,        p + 8, 4);
+    } else if (tick.type == MsgType::Quote) {
+        std::memcpy(&tick.bid_price, p,      8);
+        std::memcpy(&tick.bid_qty,   p + 8,  4);
+        std::memcpy(&tick.ask_price, p + 12, 8);
+        std::memcpy(&tick.ask_qty,   p + 20, 4);
+    } else if (tick.type == MsgType::DepthUpdate ||
+               tick.type == MsgType::DepthImage) {
+        tick.depth_side = static_cast<Side>(p[0]);
+        tick.depth_action = static_cast<DepthAction>(p[1]);
+        tick.depth_level = p[2];
+        std::memcpy(&tick.depth_price, p + 3,  8);
+        std::memcpy(&tick.depth_qty,   p + 11, 4);
+    } else if (tick.type == MsgType::Snapshot) {
+        std::memcpy(&tick.bid_price,        p,      8);
+        std::memcpy(&tick.bid_qty,          p + 8,  4);
+        std::memcpy(&tick.ask_price,        p + 12, 8);
+        std::memcpy(&tick.ask_qty,          p + 20, 4);
+        std::memcpy(&tick.last_trade_price, p + 24, 8);
+        std::memcpy(&tick.trade_qty,        p + 32, 4);
+    }
+}
+
+} // namespace wire
@@ -1,24 +1,71 @@
+
 #include "exchange_simulator.h"
+#include "wire.h"
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
 #include <algorithm>
+#include <string>
 
-ClientManager::ClientManager() {
+// Calls f(header, frame, len) for each intact frame of a batch. Bytes the
+// fault stage damaged are skipped the way the client parser skips them,
+// so one bad frame doesn't take the rest of the batch with it.
+template <typename F>
+static void for_each_frame(const uint8_t* data, size_t len, F&& f) {
+    size_t off = 0;
+    while (off + wire::MIN_FRAME_SIZE <= len) {
+        wire::FrameHeader h = wire::read_header(data + off);
+        size_t frame_len = wire::frame_size(h.type);
+        if (frame_len == 0 || off + frame_len > len ||
+            !wire::verify(data + off, frame_len)) {
+            off += 1 + wire::scan_for_frame(data + off + 1, len - off - 1);
+            continue;
+        }
+        f(h, data + off, frame_len);
+        off += frame_len;
+    }
+}
+
+ClientSession::ClientSession(int fd_, SlowConsumerPolicy policy_, size_t max_buffer_bytes)
+    : fd(fd_),
+      policy(policy_),
+      pending(policy_ == SlowConsumerPolicy::Disconnect ? 1 : max_buffer_bytes) {}
+
+ClientManager::ClientManager(size_t num_symbols)
+    : num_symbols_(num_symbols) {
     epoll_fd_ = epoll_create1(0);
 }
 
+ClientManager::~ClientManager() {
+    for (auto& c : clients_)
+        close(c->fd);
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+}
+
 void ClientManager::set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+void ClientManager::set_slow_consumer_policy(SlowConsumerPolicy policy,
+                                             size_t max_buffer_bytes) {
+    policy_ = policy;
+    max_buffer_bytes_ = std::max<size_t>(max_buffer_bytes, wire::MAX_FRAME_SIZE);
+}
+
+void ClientManager::set_accept_handler(
+        std::function<void(int, std::vector<uint8_t>)> handler) {
+    accept_handler_ = std::move(handler);
+}
+
 void ClientManager::add_listener(int listen_fd) {
     epoll_event ev{};
     ev.events = EPOLLIN;
-    ev.data.fd = listen_fd;
+    ev.data.ptr = nullptr;   // clients carry their ClientSession*
     epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd, &ev);
 }
 
@@ -30,52 +77,391 @@ void ClientManager::handle_new_connection(int listen_fd) {
             return;
         }
         set_nonblocking(fd);
+        // Frames are already batched; small writes such as replays must
+        // not wait behind Nagle for the client's delayed ACK
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ++accepted_total_;
 
-        epoll_event ev{};
-        ev.events = EPOLLIN | EPOLLET;
-        ev.data.fd = fd;
-        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+        // Built here, on the generator thread that owns the table
+        std::vector<uint8_t> snapshot;
+        if (snapshots_) snapshots_->encode(snapshot);
 
-        clients_.push_back(fd);
-        std::cout << "Client connected: fd=" << fd << "\n";
+        if (accept_handler_)
+            accept_handler_(fd, std::move(snapshot));
+        else
+            add_client(fd, snapshot);
     }
 }
 
+void ClientManager::add_client(int fd, const std::vector<uint8_t>& snapshot) {
+    clients_.push_back(
+        std::make_unique<ClientSession>(fd, policy_, max_buffer_bytes_));
+
+    // EPOLLOUT is edge-triggered: we only hear about it when a full
+    // socket becomes writable again, which is exactly when to drain.
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = clients_.back().get();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+
+    std::cout << "Client connected: fd=" << fd;
+    if (!snapshot.empty())
+        std::cout << " (snapshot " << snapshot.size() << " bytes)";
+    std::cout << "\n";
+
+    // Nothing else has been sent yet, so the burst leads the stream
+    if (!snapshot.empty() &&
+        !deliver(*clients_.back(), snapshot.data(), snapshot.size()))
+        disconnect(fd);
+}
+
 void ClientManager::disconnect(int fd) {
     epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
     close(fd);
-    clients_.erase(std::remove(clients_.begin(), clients_.end(), fd), clients_.end());
+    clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                                  [this, fd](const std::unique_ptr<ClientSession>& c) {
+                                      if (c->fd != fd) return false;
+                                      if (c->group >= 0) groups_dirty_ = true;
+                                      return true;
+                                  }),
+                   clients_.end());
 }
 
-void ClientManager::broadcast(const void* data, size_t len) {
-    for (int fd : clients_) {
-        ssize_t n = send(fd, data, len, MSG_DONTWAIT);
-        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-            disconnect(fd);
+bool ClientManager::abort_client(uint64_t pick) {
+    if (clients_.empty()) return false;
+
+    int fd = clients_[pick % clients_.size()]->fd;
+    linger lg{1, 0};   // zero linger: close() sends RST
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    std::cout << "Fault injection: reset client fd=" << fd << "\n";
+    disconnect(fd);
+    return true;
+}
+
+// ---- Subscriptions ----
+
+bool ClientManager::read_requests(ClientSession& c) {
+    uint8_t buf[4096];
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
         }
+        c.rx.insert(c.rx.end(), buf, buf + n);
     }
+
+    size_t off = 0;
+    while (off < c.rx.size()) {
+        const uint8_t* p = c.rx.data() + off;
+        size_t avail = c.rx.size() - off;
+
+        if (p[0] == wire::RETRANSMIT_REQUEST) {
+            if (avail < wire::RETRANSMIT_REQUEST_SIZE) break;
+
+            uint16_t sym;
+            uint32_t from, to;
+            std::memcpy(&sym,  p + 1, 2);
+            std::memcpy(&from, p + 3, 4);
+            std::memcpy(&to,   p + 7, 4);
+            if (!retransmit(c, sym, from, to)) return false;
+            off += wire::RETRANSMIT_REQUEST_SIZE;
+            continue;
+        }
+        if (p[0] != wire::SUBSCRIBE_REQUEST) {
+            ++off;   // unknown request byte, resync
+            continue;
+        }
+        if (avail < wire::SUBSCRIBE_HEADER_SIZE) break;
+
+        uint16_t count;
+        std::memcpy(&count, p + 1, 2);
+        size_t msg_len = wire::SUBSCRIBE_HEADER_SIZE + size_t(count) * 2;
+        if (avail < msg_len) break;
+
+        subscribe(c, p + wire::SUBSCRIBE_HEADER_SIZE, count);
+        off += msg_len;
+    }
+    c.rx.erase(c.rx.begin(), c.rx.begin() + off);
+    return true;
 }
 
-void ClientManager::handle_events(int listen_fd) {
-    // epoll_event events[128];
-    // int n = epoll_wait(epoll_fd_, events, 128, 0);
+void ClientManager::subscribe(ClientSession& c, const uint8_t* ids, uint16_t count) {
+    c.symbols.clear();
+    if (count > 0) {
+        c.symbols.assign((num_symbols_ + 63) / 64, 0);
+        for (uint16_t i = 0; i < count; ++i) {
+            uint16_t sym;
+            std::memcpy(&sym, ids + i * 2, 2);
+            if (sym < num_symbols_)
+                c.symbols[sym / 64] |= uint64_t(1) << (sym % 64);
+        }
+    }
+    groups_dirty_ = true;
+
+    std::cout << "Client fd=" << c.fd << " subscribed to "
+              << (count ? std::to_string(count) : std::string("all"))
+              << " symbols\n";
+}
+
+// ---- Retransmission ----
+
+// Replays go straight into the client's stream between two batches, so they
+// arrive ahead of any live frame sent after the request was read
+bool ClientManager::retransmit(ClientSession& c, uint16_t symbol,
+                               uint32_t from, uint32_t to) {
+    if (!retransmit_ || symbol >= num_symbols_ || from > to) return true;
+    if (!c.symbols.empty() &&
+        !(c.symbols[symbol / 64] & (uint64_t(1) << (symbol % 64))))
+        return true;
 
-    // for (int i = 0; i < n; ++i) {
-    //     if (events[i].events & (EPOLLHUP | EPOLLERR)) {
-    //         disconnect(events[i].data.fd);
-    //     }
-    // }
+    // Conflation would put the old frames in place of newer pending ones;
+    // the symbol's snapshot supersedes both and still closes the hole
+    if (c.conflating) return send_snapshot(c, symbol);
+
+    // Only the newest depth() frames of a symbol can still be held, so a
+    // wider hole is replayed from its tail; the client counts the head
+    // as unrecovered and still sees the range end at `to`
+    uint64_t last = to;
+    uint64_t first = std::max<uint64_t>(from, last + 1 > retransmit_->depth()
+                                                  ? last + 1 - retransmit_->depth() : 0);
+
+    constexpr size_t CHUNK = 64;   // frames per deliver()
+    uint8_t buf[CHUNK * wire::MAX_FRAME_SIZE];
+    size_t len = 0, frames = 0;
+    for (uint64_t seq = first; seq <= last; ++seq) {
+        len += retransmit_->fetch(symbol, uint32_t(seq), buf + len);
+        if (++frames == CHUNK || seq == last) {
+            if (len && !deliver(c, buf, len)) return false;
+            if (c.conflating) break;
+            len = frames = 0;
+        }
+    }
+
+    // Deltas are gone for good (the head of a wide hole, or the rest once
+    // conflation began): a snapshot rebuilds what they would have updated,
+    // the client's L2 book included
+    if (first > from || c.conflating) return send_snapshot(c, symbol);
+    return true;
+}
+
+bool ClientManager::send_snapshot(ClientSession& c, uint16_t symbol) {
+    snapshot_buf_.clear();
+    if (!snapshots_ || !snapshots_->encode_symbol(symbol, snapshot_buf_)) return true;
+    return deliver(c, snapshot_buf_.data(), snapshot_buf_.size());
+}
+
+void ClientManager::rebuild_groups() {
+    groups_.clear();
+    for (auto& c : clients_) {
+        c->group = -1;
+        if (c->symbols.empty()) continue;
+
+        auto it = std::find_if(groups_.begin(), groups_.end(),
+                               [&](const SubscriptionGroup& g) {
+                                   return g.symbols == c->symbols;
+                               });
+        if (it == groups_.end()) {
+            groups_.push_back({c->symbols, {}, 0});
+            it = groups_.end() - 1;
+        }
+        c->group = static_cast<int>(it - groups_.begin());
+    }
 
+    symbol_groups_.assign(num_symbols_, {});
+    for (size_t g = 0; g < groups_.size(); ++g) {
+        for (size_t sym = 0; sym < num_symbols_; ++sym) {
+            if (groups_[g].symbols[sym / 64] & (uint64_t(1) << (sym % 64)))
+                symbol_groups_[sym].push_back(static_cast<uint16_t>(g));
+        }
+    }
+    groups_dirty_ = false;
+}
+
+void ClientManager::fill_groups(const uint8_t* data, size_t len) {
+    for (auto& g : groups_) {
+        if (g.buf.size() < len) g.buf.resize(len);
+        g.len = 0;
+    }
+
+    for_each_frame(data, len, [&](const wire::FrameHeader& h,
+                                  const uint8_t* frame, size_t frame_len) {
+        if (h.type == static_cast<uint16_t>(MsgType::Heartbeat)) {
+            for (auto& g : groups_) {
+                std::memcpy(g.buf.data() + g.len, frame, frame_len);
+                g.len += frame_len;
+            }
+        } else if (h.symbol_id < num_symbols_) {
+            for (uint16_t gi : symbol_groups_[h.symbol_id]) {
+                auto& g = groups_[gi];
+                std::memcpy(g.buf.data() + g.len, frame, frame_len);
+                g.len += frame_len;
+            }
+        }
+    });
+}
+
+// ---- Slow consumer handling ----
+
+bool ClientManager::drain(ClientSession& c) {
+    while (true) {
+        const uint8_t *p1, *p2;
+        size_t n1, n2;
+        size_t avail = c.pending.peek(p1, n1, p2, n2);
+
+        if (avail == 0) {
+            if (!c.conflating) return true;
+            flush_conflated(c);
+            continue;
+        }
+
+        iovec iov[2] = {{const_cast<uint8_t*>(p1), n1},
+                        {const_cast<uint8_t*>(p2), n2}};
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n2 ? 2 : 1;
+
+        ssize_t n = sendmsg(c.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        c.pending.consume(n);
+        if (static_cast<size_t>(n) < avail)
+            return true;   // socket full again, wait for next EPOLLOUT
+    }
+}
+
+void ClientManager::conflate(ClientSession& c, const uint8_t* data, size_t len) {
+    if (c.latest.empty()) {
+        c.latest.resize(num_symbols_ * wire::MAX_FRAME_SIZE);
+        c.latest_len.assign(num_symbols_, 0);
+        c.dirty.reserve(num_symbols_);
+    }
+    c.conflating = true;
+
+    for_each_frame(data, len, [&](const wire::FrameHeader& h,
+                                  const uint8_t* frame, size_t frame_len) {
+        // Latest-per-symbol only makes sense for state, not for L2 deltas
+        // or image levels: those are dropped, and the client sees the seq gap
+        if (h.type != static_cast<uint16_t>(MsgType::Heartbeat) &&
+            h.type != static_cast<uint16_t>(MsgType::DepthUpdate) &&
+            h.type != static_cast<uint16_t>(MsgType::DepthImage) &&
+            h.symbol_id < num_symbols_) {
+            uint8_t* slot = &c.latest[h.symbol_id * wire::MAX_FRAME_SIZE];
+            if (c.latest_len[h.symbol_id] == 0)
+                c.dirty.push_back(h.symbol_id);
+            else if (wire::read_header(slot).seq > h.seq)
+                return;   // a snapshot reply already covers this frame
+            std::memcpy(slot, frame, frame_len);
+            c.latest_len[h.symbol_id] = static_cast<uint8_t>(frame_len);
+        }
+    });
+}
+
+void ClientManager::flush_conflated(ClientSession& c) {
+    size_t i = 0;
+    for (; i < c.dirty.size(); ++i) {
+        uint16_t sym = c.dirty[i];
+        if (!c.pending.write(&c.latest[sym * wire::MAX_FRAME_SIZE],
+                             c.latest_len[sym]))
+            break;
+        c.latest_len[sym] = 0;
+    }
+    c.dirty.erase(c.dirty.begin(), c.dirty.begin() + i);
+    c.conflating = !c.dirty.empty();
+}
+
+bool ClientManager::deliver(ClientSession& c, const uint8_t* data, size_t len) {
+    if (c.conflating) {
+        conflate(c, data, len);
+        return true;
+    }
+
+    // Fast path: nothing queued, write straight from the batch
+    size_t sent = 0;
+    if (c.pending.empty()) {
+        ssize_t n = send(c.fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            n = 0;
+        }
+        sent = n;
+        if (sent == len) return true;
+    }
+
+    if (c.policy == SlowConsumerPolicy::Disconnect) {
+        std::cout << "Slow consumer disconnected: fd=" << c.fd << "\n";
+        return false;
+    }
+
+    if (c.pending.write(data + sent, len - sent))
+        return true;
+
+    if (c.policy == SlowConsumerPolicy::Buffer) {
+        std::cout << "Slow consumer exceeded " << c.pending.capacity()
+                  << " bytes, disconnected: fd=" << c.fd << "\n";
+        return false;
+    }
+
+    // Conflate: finish the frame that was cut mid-send so the stream stays
+    // framed, then keep only the latest frame per symbol until we catch up.
+    size_t cut = 0;
+    while (cut < sent) {
+        size_t frame_len = wire::frame_size(wire::read_header(data + cut).type);
+        if (frame_len == 0) break;
+        cut += frame_len;
+    }
+    if (cut > sent && !c.pending.write(data + sent, cut - sent))
+        return false;
+    conflate(c, data + cut, len - cut);
+    return true;
+}
+
+void ClientManager::broadcast(const void* data, size_t len) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    if (groups_dirty_) rebuild_groups();
+    if (!groups_.empty()) fill_groups(bytes, len);
+
+    for (size_t i = 0; i < clients_.size();) {
+        ClientSession& c = *clients_[i];
+        bool ok;
+        if (c.group < 0) {
+            ok = deliver(c, bytes, len);
+        } else {
+            const SubscriptionGroup& g = groups_[c.group];
+            ok = g.len == 0 || deliver(c, g.buf.data(), g.len);
+        }
+
+        if (ok) {
+            ++i;
+        } else {
+            disconnect(clients_[i]->fd);   // erases clients_[i]
+        }
+    }
+}
+
+void ClientManager::handle_events(int listen_fd) {
     epoll_event events[128];
     int n = epoll_wait(epoll_fd_, events, 128, 0);
 
     for (int i = 0; i < n; ++i) {
-        int fd = events[i].data.fd;
+        auto* c = static_cast<ClientSession*>(events[i].data.ptr);
 
-        if (fd == listen_fd) {
+        if (c == nullptr) {
             handle_new_connection(listen_fd);
-        } else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
-            disconnect(fd);
+        } else if (events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+            disconnect(c->fd);
+        } else {
+            bool ok = true;
+            if (events[i].events & EPOLLIN)
+                ok = read_requests(*c);
+            if (ok && (events[i].events & EPOLLOUT))
+                ok = drain(*c);
+            if (!ok)
+                disconnect(c->fd);
         }
     }
 }
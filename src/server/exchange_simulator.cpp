@@ -1,6 +1,8 @@
 // src/server/exchange_simulator.cpp
 #include "exchange_simulator.h"
 #include "protocol.h"  // for Tick struct
+#include "wire.h"      // packed frame encoder
+#include "tsc_clock.h"
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
@@ -11,8 +13,21 @@
 #include <mutex>
 using namespace std;
 
+FrameBatch::FrameBatch(size_t max_msgs) {
+    set_max_msgs(max_msgs);
+}
+
+void FrameBatch::set_max_msgs(size_t max_msgs) {
+    max_msgs_ = std::max<size_t>(1, max_msgs);
+    buf_.resize(max_msgs_ * wire::MAX_FRAME_SIZE);
+    clear();
+}
+
 ExchangeSimulator::ExchangeSimulator(uint16_t port, size_t num_symbols)
-    : port_(port),num_symbols_(num_symbols),tick_generator_(num_symbols) {}
+    : port_(port),num_symbols_(num_symbols),client_manager_(num_symbols),
+      snapshots_(num_symbols),
+      tick_generator_(num_symbols),
+      batch_(batch_size_) {}
 
 void ExchangeSimulator::set_tick_rate(uint32_t ticks_per_second) {
     if (ticks_per_second > 0)
@@ -23,6 +38,88 @@ void ExchangeSimulator::enable_fault_injection(bool enable) {
     fault_injection_ = enable;
 }
 
+void ExchangeSimulator::set_fault_config(const FaultConfig& cfg) {
+    fault_config_ = cfg;
+}
+
+void ExchangeSimulator::set_batch_size(size_t max_msgs) {
+    batch_size_ = std::max<size_t>(1, max_msgs);
+    batch_.set_max_msgs(batch_size_);
+}
+
+void ExchangeSimulator::set_flush_interval(std::chrono::microseconds flush_interval) {
+    flush_interval_ = flush_interval;
+}
+
+void ExchangeSimulator::set_slow_consumer_policy(SlowConsumerPolicy policy,
+                                                 size_t max_buffer_bytes) {
+    slow_policy_ = policy;
+    max_buffer_bytes_ = max_buffer_bytes;
+    client_manager_.set_slow_consumer_policy(policy, max_buffer_bytes);
+}
+
+void ExchangeSimulator::set_sender_threads(size_t threads) {
+    sender_threads_ = threads;
+}
+
+void ExchangeSimulator::set_arrival(const ArrivalConfig& cfg) {
+    arrival_ = cfg;
+}
+
+void ExchangeSimulator::set_spin_window(std::chrono::microseconds spin) {
+    spin_window_ = spin;
+}
+
+void ExchangeSimulator::set_seed(uint64_t seed) {
+    deterministic_ = true;
+    seed_ = seed;
+    tick_generator_ = TickGenerator(num_symbols_, seed);
+    tick_generator_.set_depth_levels(depth_levels_);
+}
+
+void ExchangeSimulator::set_depth_levels(size_t levels) {
+    depth_levels_ = levels;
+    tick_generator_.set_depth_levels(levels);
+    snapshots_.set_depth_levels(tick_generator_.depth_levels());
+}
+
+void ExchangeSimulator::set_retransmit_depth(size_t frames, size_t max_bytes) {
+    retransmit_depth_ = frames;
+    retransmit_max_bytes_ = max_bytes;
+}
+
+void ExchangeSimulator::flush_batch() {
+    if (batch_.empty()) return;
+    if (broadcaster_)
+        broadcaster_->publish(batch_.data(), batch_.size());
+    else
+        client_manager_.broadcast(batch_.data(), batch_.size());
+    batch_.clear();
+}
+
+void ExchangeSimulator::inject(FaultInjector& faults, const uint8_t* frame,
+                               size_t len) {
+    uint8_t out[FaultInjector::MAX_OUTPUT];
+    size_t n = faults.apply(frame, len, out);
+
+    // Keep the output in one batch unless it's bigger than a whole batch
+    if (n > batch_.room()) flush_batch();
+    for (size_t off = 0; off < n;) {
+        size_t chunk = std::min(n - off, batch_.room());
+        std::memcpy(batch_.tail(), out + off, chunk);
+        batch_.commit(chunk);
+        off += chunk;
+        if (off < n) flush_batch();
+    }
+
+    if (faults.take_disconnect()) {
+        if (broadcaster_)
+            broadcaster_->abort_client();
+        else
+            client_manager_.abort_client(faults.injected(Fault::Disconnect));
+    }
+}
+
 void ExchangeSimulator::start() {
     listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
 
@@ -34,34 +131,159 @@ void ExchangeSimulator::start() {
     bind(listen_fd_, (sockaddr*)&addr, sizeof(addr));
     listen(listen_fd_, SOMAXCONN);
 
+    if (retransmit_depth_ > 0) {
+        size_t fit = retransmit_max_bytes_ /
+                     (std::max<size_t>(1, num_symbols_) * RetransmitStore::SLOT_BYTES);
+        if (fit < retransmit_depth_)
+            std::cout << "[server] Retransmission cut to " << std::max<size_t>(1, fit)
+                      << " frames per symbol to fit " << (retransmit_max_bytes_ >> 20)
+                      << " MB\n";
+        retransmit_ = std::make_unique<RetransmitStore>(
+            num_symbols_, std::min(retransmit_depth_, fit));
+        client_manager_.set_retransmit_store(retransmit_.get());
+        std::cout << "[server] Retransmission: last " << retransmit_->depth()
+                  << " frames per symbol (" << (retransmit_->bytes() >> 20)
+                  << " MB)\n";
+    }
+
+    if (sender_threads_ > 0) {
+        broadcaster_ = std::make_unique<ShardedBroadcaster>(
+            sender_threads_, num_symbols_,
+            batch_size_ * wire::MAX_FRAME_SIZE,
+            slow_policy_, max_buffer_bytes_, retransmit_.get(), &snapshots_);
+        client_manager_.set_accept_handler(
+            [this](int fd, std::vector<uint8_t> snapshot) {
+                broadcaster_->add_client(fd, std::move(snapshot));
+            });
+        std::cout << "[server] Fan-out sharded across "
+                  << broadcaster_->num_shards() << " sender threads\n";
+    }
+
+    client_manager_.set_snapshot_table(&snapshots_);
     client_manager_.add_listener(listen_fd_);
     run();
 }
 
 void ExchangeSimulator::run() {
-    using clock = std::chrono::high_resolution_clock;
-    auto tick_interval =
-        std::chrono::microseconds(1000000 / tick_rate_);
+    const TscClock& clock = TscClock::instance();
 
-    while (true) {
-        auto loop_start = clock::now();
+    if (deterministic_) {
+        // The stream starts with the first client so it sees it from message 0
+        while (client_manager_.accepted_total() == 0 ||
+               (broadcaster_ && broadcaster_->adopting())) {
+            client_manager_.handle_events(listen_fd_);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::cout << "[server] Deterministic stream started\n";
+    }
+
+    Pacer pacer(tick_rate_, arrival_, deterministic_ ? seed_ : clock.now_ns());
+    pacer.set_spin_ns(std::chrono::nanoseconds(spin_window_).count());
+
+    std::unique_ptr<FaultInjector> faults;
+    if (fault_injection_) {
+        faults = std::make_unique<FaultInjector>(
+            fault_config_, deterministic_ ? seed_ : clock.now_ns());
+        std::cout << "[server] Fault injection enabled:";
+        for (size_t f = 0; f < size_t(Fault::Count); ++f) {
+            if (fault_config_.rate[f] > 0)
+                std::cout << " " << fault_name(Fault(f)) << "=" << fault_config_.rate[f];
+        }
+        std::cout << "\n";
+    }
 
-        // Handle client connections & disconnects
-        client_manager_.handle_events(listen_fd_);
+    constexpr uint64_t EVENTS_EVERY_NS = 1000000;       // control plane: 1 ms
+    constexpr uint64_t HEARTBEAT_EVERY_NS = 1000000000; // 1 s of stream time
+    constexpr uint64_t STATS_EVERY_NS = 5000000000;     // 5 s wall time
+    const uint64_t flush_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(flush_interval_).count();
 
-        // Generate ticks for all symbols
-        for (uint16_t i = 0; i < num_symbols_; ++i) {
-            Tick tick;
-            if (tick_generator_.generate(i, tick)) {
-                client_manager_.broadcast(&tick, sizeof(Tick));
+    const uint64_t start_ns = clock.now_ns();
+    uint64_t next_events_ns = start_ns;
+    uint64_t next_stats_ns = start_ns + STATS_EVERY_NS;
+    uint64_t batch_deadline_ns = UINT64_MAX;
+    uint64_t last_heartbeat = 0;
+    uint32_t heartbeat_seq = 0;
+    uint64_t sent = 0, sent_at_stats = 0;
+    size_t cursor = num_symbols_;   // forces a GBM step on the first message
+
+    while (true) {
+        uint64_t offset = pacer.next();
+        uint64_t due = start_ns + offset;
+        uint64_t now = clock.now_ns();
+
+        if (now < due) {
+            // Ahead of schedule: don't hold a batch past its deadline while idle
+            if (!batch_.empty() && due >= batch_deadline_ns) flush_batch();
+            if (now >= next_events_ns) {
+                client_manager_.handle_events(listen_fd_);
+                next_events_ns = now + EVENTS_EVERY_NS;
             }
+            pacer.wait_until(due);
+            now = clock.now_ns();
+        } else if (now >= next_events_ns) {
+            client_manager_.handle_events(listen_fd_);
+            next_events_ns = now + EVENTS_EVERY_NS;
+        }
+
+        // Stream time: scheduled offset in deterministic mode, else wall time
+        uint64_t ts = deterministic_ ? VIRTUAL_EPOCH_NS + offset
+                                     : wall_clock_ns();
+
+        // One message, round-robin over symbols; a full lap = one GBM step
+        if (cursor == num_symbols_) {
+            tick_generator_.step();
+            cursor = 0;
+        }
+        Tick tick;
+        tick_generator_.emit(static_cast<uint16_t>(cursor++), ts, tick);
+        snapshots_.update(tick);
+
+        if (batch_.empty()) batch_deadline_ns = now + flush_ns;
+        // The retransmission copy is taken before the fault stage, so a
+        // dropped or damaged frame can still be replayed intact
+        if (faults) {
+            uint8_t frame[wire::MAX_FRAME_SIZE];
+            size_t len = wire::encode(tick, frame);
+            if (retransmit_) retransmit_->record(frame, len);
+            inject(*faults, frame, len);
+        } else {
+            size_t len = wire::encode(tick, batch_.tail());
+            if (retransmit_) retransmit_->record(batch_.tail(), len);
+            batch_.commit(len);
         }
+        ++sent;
+
+        if (batch_.full()) flush_batch();
 
-        // Rate control
-        auto elapsed = clock::now() - loop_start;
-        if (elapsed < tick_interval) {
-            std::this_thread::sleep_for(tick_interval - elapsed);
+        // Heartbeat once a second so idle clients can tell the line is alive
+        if (offset - last_heartbeat >= HEARTBEAT_EVERY_NS) {
+            // full() counts messages; faults can use up the bytes first
+            if (batch_.room() < wire::HEARTBEAT_FRAME_SIZE) flush_batch();
+            if (batch_.empty()) batch_deadline_ns = now + flush_ns;
+            batch_.commit(wire::encode_heartbeat(batch_.tail(), ++heartbeat_seq, ts));
+            last_heartbeat = offset;
+        }
+
+        if (batch_.full() || now >= batch_deadline_ns) flush_batch();
+
+        if (now >= next_stats_ns) {
+            double secs = double(now - next_stats_ns + STATS_EVERY_NS) * 1e-9;
+            std::cout << "[server] " << uint64_t((sent - sent_at_stats) / secs)
+                      << " msgs/s (target " << tick_rate_ << ")";
+            if (faults) {
+                std::cout << " faults:";
+                for (size_t f = 0; f < size_t(Fault::Count); ++f) {
+                    if (faults->injected(Fault(f)))
+                        std::cout << " " << fault_name(Fault(f)) << "="
+                                  << faults->injected(Fault(f));
+                }
+            }
+            if (retransmit_ && retransmit_->served())
+                std::cout << " replayed=" << retransmit_->served();
+            std::cout << "\n";
+            sent_at_stats = sent;
+            next_stats_ns = now + STATS_EVERY_NS;
         }
     }
 }
-
@@ -2,7 +2,6 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
 #include <cstdint>
 #include <random>
 #include <chrono>
@@ -11,47 +10,442 @@
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
 #include "protocol.h"  // for Tick struct
+#include "ring_buffer.h"
+#include "wire.h"
 
 using namespace std;
 
 /************************************************************************************************ */
-//  USED as SEParate 
-struct SymbolState {
-    double price;
-    double volatility;
-    double drift;
-    double spread;
-    uint64_t seq_no;
+// GBM tick generator, structure-of-arrays: one contiguous array per field
+// so step() advances every symbol in a single vectorisable pass.
+class TickGenerator {
+public:
+    TickGenerator(size_t num_symbols, uint64_t seed = std::random_device{}());
+
+    size_t size() const { return price_.size(); }
+
+    // Advance all symbols one GBM step (prices, spreads, trade/quote pick)
+    void step();
+
+    // Emit the current state of one symbol as a tick stamped `ts_ns`
+    void emit(uint16_t symbol_id, uint64_t ts_ns, Tick& out);
+
+    // 0 (default) = top of book only. N > 0 also emits DepthUpdate ticks
+    // maintaining an N-level book per side (max 20), in place of part of
+    // the quotes.
+    void set_depth_levels(size_t levels);
+    size_t depth_levels() const { return depth_levels_; }
+
+    // step() + emit() for every symbol, all stamped `ts_ns`;
+    // `out` holds size() ticks
+    size_t generate_all(Tick* out, uint64_t ts_ns);
+
+private:
+    void emit_depth(uint16_t symbol_id, Tick& tick);
+
+    // Per-symbol state
+    std::vector<double> price_;
+    std::vector<double> vol_;
+    std::vector<double> drift_;
+    std::vector<double> spread_;
+    std::vector<uint64_t> seq_;
+
+    // Per-step outputs
+    std::vector<double> bid_;
+    std::vector<double> ask_;
+    std::vector<uint8_t> kind_;     // TickKind per symbol
+    std::vector<float> z_;          // N(0,1) draws, one per symbol
+
+    // L2: levels the generated book has per side, [symbol * 2 + side]
+    size_t depth_levels_{0};
+    std::vector<uint8_t> depth_count_;
+
+    // Counter-based RNG: output = hash(counter, key), no sequential state
+    uint32_t key_lo_;
+    uint32_t key_hi_;
+    uint64_t step_{0};
 };
 
-class TickGenerator {
+// Inter-arrival model for generated messages
+enum class ArrivalProcess {
+    Constant,   // evenly spaced at the configured rate
+    Poisson,    // exponential gaps, mean = 1 / rate
+    Bursty      // Poisson, modulated by a market-open surge and microbursts
+};
+
+struct ArrivalConfig {
+    ArrivalProcess process{ArrivalProcess::Constant};
+
+    // Bursty only: rate starts at open_boost x and decays to 1x with time
+    // constant open_decay_s; every burst_every_ms the rate is multiplied by
+    // burst_factor for burst_len_ms.
+    double open_boost{5.0};
+    double open_decay_s{30.0};
+    double burst_factor{10.0};
+    uint32_t burst_every_ms{100};
+    uint32_t burst_len_ms{5};
+};
+
+// Per-message scheduler: yields the arrival time of each message as an
+// offset from stream start and waits for it with sleep-then-spin.
+class Pacer {
+public:
+    Pacer(double msgs_per_second, const ArrivalConfig& cfg, uint64_t seed);
+
+    // Offset (ns since stream start) of the next message
+    uint64_t next();
+
+    // Block until TscClock::now_ns() >= deadline_ns: sleep while more than
+    // spin_ns remains, then busy-poll the TSC.
+    void wait_until(uint64_t deadline_ns) const;
+
+    void set_spin_ns(uint64_t spin_ns) { spin_ns_ = spin_ns; }
+
+private:
+    double rate_at(double t_sec) const;
+    double uniform();   // (0, 1]
+
+    double rate_;
+    ArrivalConfig cfg_;
+    uint64_t rng_state_;
+    double t_ns_{0};
+    uint64_t spin_ns_{50000};
+};
+
+// Faults the simulator can inject into the outgoing stream
+enum class Fault : uint8_t {
+    CorruptChecksum,   // flip bits in the checksum field
+    Truncate,          // send only a prefix of the frame
+    Garbage,           // random bytes ahead of the frame
+    DropSeq,           // skip the frame (per-symbol seq gap)
+    Duplicate,         // send the frame twice
+    Reorder,           // hold the frame back behind the next one
+    Disconnect,        // reset a client connection (RST, no FIN)
+    Count
+};
+
+const char* fault_name(Fault f);
+
+// Per-message probability of each fault; at most one fault per message
+struct FaultConfig {
+    double rate[size_t(Fault::Count)]{};
+
+    double& operator[](Fault f) { return rate[size_t(f)]; }
+    double operator[](Fault f) const { return rate[size_t(f)]; }
+};
+
+// Seeded fault stage between the encoder and the batch. The same seed and
+// config damage the same messages in the same way on every run.
+class FaultInjector {
+public:
+    // Held (reordered) frame + current frame + up to one frame of garbage
+    static constexpr size_t MAX_OUTPUT = 3 * wire::MAX_FRAME_SIZE;
+
+    FaultInjector(const FaultConfig& cfg, uint64_t seed);
+
+    // Pass one encoded frame through the fault stage: writes the bytes that
+    // should go on the wire to `out` and returns their length (may be 0)
+    size_t apply(const uint8_t* frame, size_t len, uint8_t* out);
+
+    // True once for each injected Disconnect; the caller drops a client
+    bool take_disconnect();
+
+    uint64_t injected(Fault f) const { return counts_[size_t(f)]; }
+    uint64_t injected_total() const;
+
+private:
+    uint64_t next();
+    Fault pick();
+
+    FaultConfig cfg_;
+    double total_rate_{0};
+    uint64_t rng_state_;
+    uint64_t counts_[size_t(Fault::Count)]{};
+
+    uint8_t held_[wire::MAX_FRAME_SIZE];
+    size_t held_len_{0};
+    bool disconnect_pending_{false};
+};
+
+// Contiguous send buffer that collects encoded frames so a whole sweep of
+// ticks goes out to each client with a single send().
+class FrameBatch {
+public:
+    explicit FrameBatch(size_t max_msgs = 1);
+
+    void set_max_msgs(size_t max_msgs);
+
+    // Space for one more frame (at least wire::MAX_FRAME_SIZE bytes)
+    uint8_t* tail() { return buf_.data() + len_; }
+    void commit(size_t frame_len) { len_ += frame_len; ++msgs_; }
+
+    // Bytes left; fault-injected output can be up to three frames long
+    size_t room() const { return buf_.size() - len_; }
+
+    bool full() const { return msgs_ >= max_msgs_; }
+    bool empty() const { return msgs_ == 0; }
+    void clear() { len_ = 0; msgs_ = 0; }
+
+    const uint8_t* data() const { return buf_.data(); }
+    size_t size() const { return len_; }
+    size_t msgs() const { return msgs_; }
+
+private:
+    std::vector<uint8_t> buf_;
+    size_t len_{0};
+    size_t msgs_{0};
+    size_t max_msgs_{1};
+};
+
+// Bounded retransmission ring: the last `depth` frames of every symbol,
+// slot = seq % depth. The generator thread records each clean frame before
+// it reaches the fault stage; any sender thread can fetch one back for a
+// client's RETRANSMIT_REQUEST. Slots use the same single-writer seqlock as
+// the client cache, so fetches never block the generator.
+class RetransmitStore {
+public:
+    RetransmitStore(size_t num_symbols, size_t depth);
+
+    // Allocated up front: num_symbols * depth slots of this size
+    static constexpr size_t SLOT_BYTES = 64;
+
+    size_t depth() const { return depth_; }
+    size_t bytes() const { return num_symbols_ * depth_ * SLOT_BYTES; }
+
+    // Generator thread only; heartbeats and unknown symbols are ignored
+    void record(const uint8_t* frame, size_t len);
+
+    // Copy frame `seq` of `symbol` into `out` (MAX_FRAME_SIZE bytes) if it
+    // is still held; returns its length, or 0 if it has been overwritten
+    size_t fetch(uint16_t symbol, uint32_t seq, uint8_t* out) const;
+
+    uint64_t served() const { return served_.load(std::memory_order_relaxed); }
+
+private:
+    // seq and length are read back from the frame itself (type 0 = empty)
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> lock{0};   // odd while being overwritten
+        uint8_t frame[wire::MAX_FRAME_SIZE]{};
+    };
+    static_assert(sizeof(Slot) == SLOT_BYTES, "one cache line per retained frame");
+
+    size_t num_symbols_;
+    size_t depth_;
+    std::unique_ptr<Slot[]> slots_;
+    mutable std::atomic<uint64_t> served_{0};
+};
+
+// Latest top of book and L2 book per symbol as the generator has emitted
+// them, tagged with the symbol's last seq. A newly accepted client gets
+// them as a burst of DepthImage + Snapshot frames before any live data,
+// so its books are full at once instead of filling in one symbol per
+// tick, and a reconnecting client can rebuild an L2 book that per-level
+// deltas alone never repair. A retransmit that can't be served in full is
+// answered with one symbol's entry. Only the generator thread writes; each
+// symbol is a seqlock, as in RetransmitStore, so any thread can encode.
+class SnapshotTable {
 public:
-    TickGenerator(size_t num_symbols);
+    explicit SnapshotTable(size_t num_symbols);
+
+    // Levels kept per side; must match the generator's (0 = no L2 book).
+    // Before any reader starts.
+    void set_depth_levels(size_t levels);
+
+    // Fold one generated tick into its symbol's state
+    void update(const Tick& tick);
+
+    // Append every symbol that has ticked: its DepthImage frames, then its
+    // Snapshot frame. Returns the number of symbols.
+    size_t encode(std::vector<uint8_t>& out) const;
 
-    // Generate one tick for a symbol
-    bool generate(uint16_t symbol_id, Tick& out);
+    // Append one symbol's frames, as above; false if it hasn't ticked or
+    // kept changing under the read
+    bool encode_symbol(uint16_t symbol, std::vector<uint8_t>& out) const;
 
 private:
-    std::unordered_map<uint16_t, SymbolState> symbols_;
-    std::mt19937_64 rng_;
+    struct Level {
+        double price;
+        uint32_t qty;
+    };
+    Level* side_levels(size_t symbol, Side side) {
+        return &levels_[(symbol * 2 + size_t(side)) * depth_];
+    }
+    const Level* side_levels(size_t symbol, Side side) const {
+        return &levels_[(symbol * 2 + size_t(side)) * depth_];
+    }
+
+    std::vector<Tick> state_;   // type = Snapshot; seq_no 0 = never ticked
+    size_t depth_{0};
+    std::vector<Level> levels_;     // bids then asks per symbol, depth_ each
+    std::vector<uint8_t> counts_;   // levels in use, per symbol and side
+    std::unique_ptr<std::atomic<uint64_t>[]> locks_;   // odd while written
+};
+
+// What to do with a client whose socket can't keep up with the feed
+enum class SlowConsumerPolicy {
+    Buffer,      // queue up to max_buffer_bytes, then disconnect
+    Conflate,    // queue up to max_buffer_bytes, then keep latest-per-symbol
+    Disconnect   // disconnect as soon as any backlog builds up
+};
+
+struct ClientSession {
+    ClientSession(int fd, SlowConsumerPolicy policy, size_t max_buffer_bytes);
+
+    int fd;
+    SlowConsumerPolicy policy;
+    SpscByteRing pending;            // unsent tail of the stream
+
+    // Subscription: bitmap of wanted symbols (empty = full feed) and the
+    // index of the SubscriptionGroup that serves it (-1 = full feed)
+    std::vector<uint64_t> symbols;
+    int group{-1};
+    std::vector<uint8_t> rx;         // partial client->server request
+
+    // Conflation state (allocated on first use)
+    bool conflating{false};
+    std::vector<uint8_t> latest;     // num_symbols * MAX_FRAME_SIZE
+    std::vector<uint8_t> latest_len; // 0 = no frame pending for symbol
+    std::vector<uint16_t> dirty;     // symbols with a pending frame
 };
 
 class ClientManager {
 public:
-    ClientManager();
+    explicit ClientManager(size_t num_symbols);
+    ~ClientManager();
 
     void add_listener(int listen_fd);
     void handle_events(int listen_fd);
     void broadcast(const void* data, size_t len);
 
+    // Take ownership of an already-accepted socket; `snapshot` (Snapshot
+    // frames) goes out ahead of any live data
+    void add_client(int fd, const std::vector<uint8_t>& snapshot = {});
+    size_t client_count() const { return clients_.size(); }
+
+    // Sockets accepted so far, whether adopted here or handed off
+    uint64_t accepted_total() const { return accepted_total_; }
+
+    // Reset one client (picked by `pick` modulo the client count) without
+    // a FIN, as a crashed gateway would. Returns false if there are none.
+    bool abort_client(uint64_t pick);
+
+    // Hand accepted sockets, with their snapshot burst, to `handler`
+    // instead of adopting them here
+    void set_accept_handler(std::function<void(int, std::vector<uint8_t>)> handler);
+
+    // Applied to clients accepted after the call
+    void set_slow_consumer_policy(SlowConsumerPolicy policy,
+                                  size_t max_buffer_bytes);
+
+    // Where RETRANSMIT_REQUESTs are served from; null = ignore them
+    void set_retransmit_store(const RetransmitStore* store) { retransmit_ = store; }
+
+    // Snapshot sent to each accepted client, and one symbol of it to answer
+    // a retransmit that can't be replayed in full; null = neither. The
+    // full burst is encoded on the accepting thread, which must be the
+    // generator thread.
+    void set_snapshot_table(const SnapshotTable* table) { snapshots_ = table; }
+
 private:
+    // Clients with identical subscriptions share one filtered buffer, built
+    // once per batch; each frame is copied only into groups that want it.
+    struct SubscriptionGroup {
+        std::vector<uint64_t> symbols;
+        std::vector<uint8_t> buf;
+        size_t len{0};
+    };
+
     int epoll_fd_;
-    std::vector<int> clients_;
+    size_t num_symbols_;
+    SlowConsumerPolicy policy_{SlowConsumerPolicy::Buffer};
+    size_t max_buffer_bytes_{4 << 20};
+    std::vector<std::unique_ptr<ClientSession>> clients_;
+    std::function<void(int, std::vector<uint8_t>)> accept_handler_;
+    uint64_t accepted_total_{0};
+    const RetransmitStore* retransmit_{nullptr};
+    const SnapshotTable* snapshots_{nullptr};
+    std::vector<uint8_t> snapshot_buf_;   // one symbol, for send_snapshot
+
+    std::vector<SubscriptionGroup> groups_;
+    std::vector<std::vector<uint16_t>> symbol_groups_;  // symbol -> groups
+    bool groups_dirty_{false};
 
     void set_nonblocking(int fd);
     void handle_new_connection(int listen_fd);
     void disconnect(int fd);
+
+    // Returns false if the client had to be dropped
+    bool deliver(ClientSession& c, const uint8_t* data, size_t len);
+    bool drain(ClientSession& c);
+    void conflate(ClientSession& c, const uint8_t* data, size_t len);
+    void flush_conflated(ClientSession& c);
+
+    // Client -> server requests
+    bool read_requests(ClientSession& c);
+    void subscribe(ClientSession& c, const uint8_t* ids, uint16_t count);
+    bool retransmit(ClientSession& c, uint16_t symbol, uint32_t from, uint32_t to);
+    bool send_snapshot(ClientSession& c, uint16_t symbol);
+    void rebuild_groups();
+    void fill_groups(const uint8_t* data, size_t len);
+};
+
+
+// Fans batches out from K sender threads. Each shard owns an epoll
+// instance and a disjoint set of clients; the generator publishes each batch
+// once into a BroadcastRing that every shard reads without locking.
+class ShardedBroadcaster {
+public:
+    ShardedBroadcaster(size_t num_shards, size_t num_symbols,
+                       size_t max_batch_bytes,
+                       SlowConsumerPolicy policy, size_t max_buffer_bytes,
+                       const RetransmitStore* retransmit = nullptr,
+                       const SnapshotTable* snapshots = nullptr);
+    ~ShardedBroadcaster();
+
+    // Assign an accepted socket to the next shard (round-robin); the shard
+    // sends `snapshot` first when it adopts the socket
+    void add_client(int fd, std::vector<uint8_t> snapshot = {});
+
+    // Generator thread only
+    void publish(const void* data, size_t len);
+
+    size_t num_shards() const { return shards_.size(); }
+
+    // Reset one client on the next shard in turn (see
+    // ClientManager::abort_client); applied by the shard's own thread
+    void abort_client();
+
+    // True while some shard still has sockets it hasn't started serving
+    bool adopting() const;
+
+private:
+    struct Shard {
+        explicit Shard(size_t num_symbols) : clients(num_symbols) {}
+
+        ClientManager clients;
+        std::thread thread;
+
+        // Control plane only: sockets waiting to be adopted by this shard
+        std::mutex pending_mtx;
+        std::vector<std::pair<int, std::vector<uint8_t>>> pending_fds;
+        std::atomic<bool> has_pending{false};
+
+        std::atomic<uint32_t> aborts{0};
+        uint64_t abort_pick{0};
+    };
+
+    void shard_loop(size_t id);
+    void adopt_pending(Shard& s);
+
+    BroadcastRing ring_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> running_{true};
+    size_t next_shard_{0};
+    size_t next_abort_shard_{0};
 };
 
 
@@ -69,20 +463,77 @@ public:
     // Configuration
     void set_tick_rate(uint32_t ticks_per_second);
     void enable_fault_injection(bool enable);
+    void set_fault_config(const FaultConfig& cfg);
+
+    // Batching: flush once `max_msgs` frames are buffered, or once the
+    // oldest buffered frame is `flush_interval` old (0 = flush whenever the
+    // generator is ahead of schedule, i.e. batch only when catching up).
+    void set_batch_size(size_t max_msgs);
+    void set_flush_interval(std::chrono::microseconds flush_interval);
+
+    // How clients that fall behind are treated (see SlowConsumerPolicy)
+    void set_slow_consumer_policy(SlowConsumerPolicy policy,
+                                  size_t max_buffer_bytes);
+
+    // 0 = send from the generator thread; K > 0 = shard clients across K
+    // sender threads (see ShardedBroadcaster). Takes effect in start().
+    void set_sender_threads(size_t threads);
+
+    // Arrival process for the per-message pacer (tick rate = msgs/s)
+    void set_arrival(const ArrivalConfig& cfg);
+    void set_spin_window(std::chrono::microseconds spin);
+
+    // Deterministic replay: seed the generator, stamp ticks from a virtual
+    // clock (VIRTUAL_EPOCH_NS + scheduled arrival offset) and hold generation
+    // until the first client is connected, so the same seed always yields
+    // a byte-identical stream.
+    void set_seed(uint64_t seed);
+
+    // L2 depth updates per side (0 = off), see TickGenerator::set_depth_levels
+    void set_depth_levels(size_t levels);
+
+    // Frames kept per symbol for retransmission (0 = no replay service),
+    // cut down if the store would exceed `max_bytes` (64 B per frame per
+    // symbol, all allocated up front). Takes effect in start().
+    void set_retransmit_depth(size_t frames, size_t max_bytes);
+
+    static constexpr uint64_t VIRTUAL_EPOCH_NS = 1700000000000000000ULL;
 
 private:
     // Configuration
     uint16_t port_;
     size_t num_symbols_;
-    uint32_t tick_rate_{10000};
+    uint32_t tick_rate_{100000};   // messages per second
     bool fault_injection_{false};
+    FaultConfig fault_config_;
+    size_t batch_size_{1024};
+    std::chrono::microseconds flush_interval_{100};
+    size_t sender_threads_{0};
+    bool deterministic_{false};
+    uint64_t seed_{0};
+    size_t depth_levels_{0};
+    size_t retransmit_depth_{1024};
+    size_t retransmit_max_bytes_{256 << 20};
+    ArrivalConfig arrival_;
+    std::chrono::microseconds spin_window_{50};
+    SlowConsumerPolicy slow_policy_{SlowConsumerPolicy::Buffer};
+    size_t max_buffer_bytes_{4 << 20};
 
     // Networking
     int listen_fd_{-1};
     ClientManager client_manager_;
+    std::unique_ptr<ShardedBroadcaster> broadcaster_;
+    std::unique_ptr<RetransmitStore> retransmit_;
+    SnapshotTable snapshots_;
 
     // Market data
     TickGenerator tick_generator_;
+    FrameBatch batch_;
+
+    void flush_batch();
+
+    // Fault stage: push one frame through `faults`, then batch the result
+    void inject(FaultInjector& faults, const uint8_t* frame, size_t len);
 };
 /***********************************************************************************************/
 
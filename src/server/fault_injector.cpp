@@ -0,0 +1,111 @@
+// src/server/fault_injector.cpp
+#include "exchange_simulator.h"
+#include <cstring>
+
+namespace {
+
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+const char* const FAULT_NAMES[size_t(Fault::Count)] = {
+    "corrupt", "truncate", "garbage", "drop", "dup", "reorder", "disconnect"
+};
+
+} // anonymous namespace
+
+const char* fault_name(Fault f) {
+    return f < Fault::Count ? FAULT_NAMES[size_t(f)] : "none";
+}
+
+FaultInjector::FaultInjector(const FaultConfig& cfg, uint64_t seed)
+    : cfg_(cfg),
+      rng_state_(seed ^ 0xfa017fa017fa017ULL) {
+    for (double r : cfg_.rate) total_rate_ += r;
+}
+
+uint64_t FaultInjector::next() {
+    return splitmix64(rng_state_);
+}
+
+Fault FaultInjector::pick() {
+    // One draw per message; the rates partition [0, total_rate_)
+    double u = double(next() >> 11) * (1.0 / 9007199254740992.0);
+    if (u >= total_rate_) return Fault::Count;
+
+    for (size_t i = 0; i < size_t(Fault::Count); ++i) {
+        if (u < cfg_.rate[i]) return Fault(i);
+        u -= cfg_.rate[i];
+    }
+    return Fault::Count;
+}
+
+size_t FaultInjector::apply(const uint8_t* frame, size_t len, uint8_t* out) {
+    Fault f = pick();
+    if (f == Fault::Reorder && held_len_ != 0) f = Fault::Count;   // one at a time
+    if (f != Fault::Count) ++counts_[size_t(f)];
+
+    size_t n = 0;
+    switch (f) {
+    case Fault::CorruptChecksum: {
+        std::memcpy(out, frame, len);
+        uint32_t flip = uint32_t(next()) | 1;   // never a no-op
+        for (size_t i = 0; i < wire::CHECKSUM_SIZE; ++i)
+            out[len - wire::CHECKSUM_SIZE + i] ^= uint8_t(flip >> (8 * i));
+        n = len;
+        break;
+    }
+    case Fault::Truncate:
+        n = 1 + next() % (len - 1);   // 1 .. len-1 bytes
+        std::memcpy(out, frame, n);
+        break;
+    case Fault::Garbage: {
+        size_t junk = 1 + next() % wire::MAX_FRAME_SIZE;
+        for (size_t i = 0; i < junk; ++i) out[i] = uint8_t(next());
+        std::memcpy(out + junk, frame, len);
+        n = junk + len;
+        break;
+    }
+    case Fault::DropSeq:
+        break;
+    case Fault::Duplicate:
+        std::memcpy(out, frame, len);
+        std::memcpy(out + len, frame, len);
+        n = 2 * len;
+        break;
+    case Fault::Reorder:
+        // Goes out right behind the next message
+        std::memcpy(held_, frame, len);
+        held_len_ = len;
+        return 0;
+    case Fault::Disconnect:
+        disconnect_pending_ = true;
+        [[fallthrough]];
+    default:
+        std::memcpy(out, frame, len);
+        n = len;
+        break;
+    }
+
+    if (held_len_ != 0) {
+        std::memcpy(out + n, held_, held_len_);
+        n += held_len_;
+        held_len_ = 0;
+    }
+    return n;
+}
+
+bool FaultInjector::take_disconnect() {
+    bool pending = disconnect_pending_;
+    disconnect_pending_ = false;
+    return pending;
+}
+
+uint64_t FaultInjector::injected_total() const {
+    uint64_t total = 0;
+    for (uint64_t c : counts_) total += c;
+    return total;
+}
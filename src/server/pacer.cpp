@@ -0,0 +1,76 @@
+// src/server/pacer.cpp
+#include "exchange_simulator.h"
+#include "tsc_clock.h"
+#include <cmath>
+
+namespace {
+
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+} // anonymous namespace
+
+Pacer::Pacer(double msgs_per_second, const ArrivalConfig& cfg, uint64_t seed)
+    : rate_(msgs_per_second > 0 ? msgs_per_second : 1.0),
+      cfg_(cfg),
+      rng_state_(seed ^ 0x5ca1ab1e0ddba11ULL) {}
+
+double Pacer::uniform() {
+    return double((splitmix64(rng_state_) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+double Pacer::rate_at(double t_sec) const {
+    double r = rate_;
+    if (cfg_.process != ArrivalProcess::Bursty) return r;
+
+    // Market-open surge decaying towards the base rate
+    if (cfg_.open_decay_s > 0)
+        r *= 1.0 + (cfg_.open_boost - 1.0) * std::exp(-t_sec / cfg_.open_decay_s);
+
+    // Periodic microbursts
+    if (cfg_.burst_every_ms > 0) {
+        uint64_t t_ms = uint64_t(t_sec * 1000.0);
+        if (t_ms % cfg_.burst_every_ms < cfg_.burst_len_ms)
+            r *= cfg_.burst_factor;
+    }
+    return r;
+}
+
+uint64_t Pacer::next() {
+    double gap_ns;
+    switch (cfg_.process) {
+    case ArrivalProcess::Constant:
+        gap_ns = 1e9 / rate_;
+        break;
+    case ArrivalProcess::Poisson:
+        gap_ns = -std::log(uniform()) * 1e9 / rate_;
+        break;
+    case ArrivalProcess::Bursty:
+    default:
+        gap_ns = -std::log(uniform()) * 1e9 / rate_at(t_ns_ * 1e-9);
+        break;
+    }
+    t_ns_ += gap_ns;
+    return uint64_t(t_ns_);
+}
+
+void Pacer::wait_until(uint64_t deadline_ns) const {
+    const TscClock& clock = TscClock::instance();
+
+    uint64_t now = clock.now_ns();
+    if (now >= deadline_ns) return;
+
+    // Coarse part: let the scheduler have the core
+    if (deadline_ns - now > spin_ns_) {
+        std::this_thread::sleep_for(
+            std::chrono::nanoseconds(deadline_ns - now - spin_ns_));
+    }
+
+    // Fine part: spin on the TSC
+    while (clock.now_ns() < deadline_ns)
+        TscClock::cpu_relax();
+}
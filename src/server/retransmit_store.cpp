@@ -0,0 +1,50 @@
+// src/server/retransmit_store.cpp
+#include "exchange_simulator.h"
+#include "wire.h"
+#include <cstring>
+
+RetransmitStore::RetransmitStore(size_t num_symbols, size_t depth)
+    : num_symbols_(num_symbols),
+      depth_(std::max<size_t>(1, depth)),
+      slots_(new Slot[num_symbols * depth_]) {}
+
+void RetransmitStore::record(const uint8_t* frame, size_t len) {
+    wire::FrameHeader h = wire::read_header(frame);
+    if (h.type == static_cast<uint16_t>(MsgType::Heartbeat) ||
+        h.symbol_id >= num_symbols_ || len > wire::MAX_FRAME_SIZE)
+        return;
+
+    Slot& s = slots_[size_t(h.symbol_id) * depth_ + h.seq % depth_];
+
+    uint64_t lock = s.lock.load(std::memory_order_relaxed);
+    s.lock.store(lock + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(s.frame, frame, len);
+
+    s.lock.store(lock + 2, std::memory_order_release);
+}
+
+size_t RetransmitStore::fetch(uint16_t symbol, uint32_t seq, uint8_t* out) const {
+    if (symbol >= num_symbols_) return 0;
+    const Slot& s = slots_[size_t(symbol) * depth_ + seq % depth_];
+
+    // A slot only changes when the generator laps it, so a failed read means
+    // the frame is being replaced: retry briefly, then report it gone
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        uint64_t start = s.lock.load(std::memory_order_acquire);
+        if (start & 1) continue;
+
+        std::memcpy(out, s.frame, wire::MAX_FRAME_SIZE);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.lock.load(std::memory_order_relaxed) != start) continue;
+
+        wire::FrameHeader h = wire::read_header(out);
+        size_t len = wire::frame_size(h.type);
+        if (h.seq != seq || len == 0) return 0;
+        served_.fetch_add(1, std::memory_order_relaxed);
+        return len;
+    }
+    return 0;
+}
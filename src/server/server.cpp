@@ -1,21 +1,122 @@
+
 #include "exchange_simulator.h"
+#include <iostream>
+#include <string>
+
+struct ServerOptions {
+    int port = 9876;
+    size_t num_symbols = 100;
+    uint32_t tick_rate = 100000;
+    size_t batch_size = 1024;
+    uint32_t flush_us = 100;
+    uint32_t spin_us = 50;
+    ArrivalConfig arrival;
+    SlowConsumerPolicy slow_policy = SlowConsumerPolicy::Buffer;
+    size_t max_buffer_mb = 4;
+    size_t sender_threads = 0;
+    bool seeded = false;
+    uint64_t seed = 0;
+    size_t depth = 0;
+    size_t retransmit = 1024;
+    size_t retransmit_mb = 256;
+    bool faults = false;
+    FaultConfig fault_config;
+};
+
+static SlowConsumerPolicy parse_policy(const std::string& s) {
+    if (s == "conflate")   return SlowConsumerPolicy::Conflate;
+    if (s == "disconnect") return SlowConsumerPolicy::Disconnect;
+    return SlowConsumerPolicy::Buffer;
+}
+
+static ArrivalProcess parse_arrival(const std::string& s) {
+    if (s == "poisson") return ArrivalProcess::Poisson;
+    if (s == "bursty")  return ArrivalProcess::Bursty;
+    return ArrivalProcess::Constant;
+}
 
+// "corrupt=1e-4,truncate=1e-4,disconnect=1e-6"; "all=R" sets every fault
+static FaultConfig parse_faults(const std::string& spec) {
+    FaultConfig cfg;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(pos, end - pos);
+        pos = end + 1;
 
-void run_exchange(int port) {
-    ExchangeSimulator sim(port, 100);
-    sim.set_tick_rate(10000);
-    sim.enable_fault_injection(false);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) continue;
+        std::string name = item.substr(0, eq);
+        double rate = std::strtod(item.c_str() + eq + 1, nullptr);
+
+        bool known = false;
+        for (size_t f = 0; f < size_t(Fault::Count); ++f) {
+            if (name == "all" || name == fault_name(Fault(f))) {
+                cfg.rate[f] = rate;
+                known = true;
+            }
+        }
+        if (!known) std::cerr << "[server] Ignoring unknown fault " << name << "\n";
+    }
+    return cfg;
+}
+
+void run_exchange(const ServerOptions& opt) {
+    ExchangeSimulator sim(opt.port, opt.num_symbols);
+    sim.set_tick_rate(opt.tick_rate);
+    sim.set_batch_size(opt.batch_size);
+    sim.set_flush_interval(std::chrono::microseconds(opt.flush_us));
+    sim.set_arrival(opt.arrival);
+    sim.set_spin_window(std::chrono::microseconds(opt.spin_us));
+    sim.set_slow_consumer_policy(opt.slow_policy, opt.max_buffer_mb << 20);
+    sim.set_sender_threads(opt.sender_threads);
+    if (opt.seeded)
+        sim.set_seed(opt.seed);
+    sim.set_depth_levels(opt.depth);
+    sim.set_retransmit_depth(opt.retransmit, opt.retransmit_mb << 20);
+    sim.set_fault_config(opt.fault_config);
+    sim.enable_fault_injection(opt.faults);
     sim.start();
 }
 
 int main(int argc, char* argv[]) {
-    int port = 9876; // default
+    ServerOptions opt;
 
-    if (argc >= 3 && std::string(argv[1]) == "--port") {
-        port = std::atoi(argv[2]);
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--port")          opt.port = std::atoi(argv[i + 1]);
+        else if (arg == "--symbols")  opt.num_symbols = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--rate")     opt.tick_rate = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--batch")    opt.batch_size = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--flush-us") opt.flush_us = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--slow-policy")   opt.slow_policy = parse_policy(argv[i + 1]);
+        else if (arg == "--max-buffer-mb") opt.max_buffer_mb = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--threads")       opt.sender_threads = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--arrival")       opt.arrival.process = parse_arrival(argv[i + 1]);
+        else if (arg == "--burst-factor")  opt.arrival.burst_factor = std::strtod(argv[i + 1], nullptr);
+        else if (arg == "--spin-us")       opt.spin_us = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--depth")         opt.depth = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--retransmit")    opt.retransmit = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--retransmit-mb") opt.retransmit_mb = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (arg == "--faults") {
+            opt.faults = true;
+            opt.fault_config = parse_faults(argv[i + 1]);
+        }
+        else if (arg == "--seed") {
+            opt.seeded = true;
+            opt.seed = std::strtoull(argv[i + 1], nullptr, 0);
+        }
+        else std::cerr << "[server] Ignoring unknown option " << arg << "\n";
     }
 
-    std::cout << "[server] Starting exchange on port " << port << "\n";
-    run_exchange(port);
+    std::cout << "[server] Starting exchange on port " << opt.port
+              << " (symbols=" << opt.num_symbols
+              << " rate=" << opt.tick_rate
+              << " batch=" << opt.batch_size
+              << " flush_us=" << opt.flush_us;
+    if (opt.seeded) std::cout << " seed=" << opt.seed;
+    if (opt.depth) std::cout << " depth=" << opt.depth;
+    std::cout << ")\n";
+    run_exchange(opt);
 }
-
@@ -0,0 +1,104 @@
+// src/server/sharded_broadcaster.cpp
+#include "exchange_simulator.h"
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+constexpr size_t RING_SLOTS = 256;   // batches in flight between generator and shards
+}
+
+ShardedBroadcaster::ShardedBroadcaster(size_t num_shards, size_t num_symbols,
+                                       size_t max_batch_bytes,
+                                       SlowConsumerPolicy policy,
+                                       size_t max_buffer_bytes,
+                                       const RetransmitStore* retransmit,
+                                       const SnapshotTable* snapshots)
+    : ring_(RING_SLOTS, max_batch_bytes, std::max<size_t>(1, num_shards)) {
+    num_shards = std::max<size_t>(1, num_shards);
+
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>(num_symbols));
+        shards_.back()->clients.set_slow_consumer_policy(policy, max_buffer_bytes);
+        shards_.back()->clients.set_retransmit_store(retransmit);
+        shards_.back()->clients.set_snapshot_table(snapshots);
+    }
+    for (size_t i = 0; i < num_shards; ++i) {
+        shards_[i]->thread = std::thread([this, i] { shard_loop(i); });
+    }
+}
+
+ShardedBroadcaster::~ShardedBroadcaster() {
+    running_.store(false, std::memory_order_release);
+    for (auto& s : shards_) {
+        if (s->thread.joinable()) s->thread.join();
+        for (auto& p : s->pending_fds) close(p.first);
+    }
+}
+
+void ShardedBroadcaster::add_client(int fd, std::vector<uint8_t> snapshot) {
+    Shard& s = *shards_[next_shard_];
+    next_shard_ = (next_shard_ + 1) % shards_.size();
+
+    std::lock_guard<std::mutex> lock(s.pending_mtx);
+    s.pending_fds.emplace_back(fd, std::move(snapshot));
+    s.has_pending.store(true, std::memory_order_release);
+}
+
+bool ShardedBroadcaster::adopting() const {
+    for (auto& s : shards_) {
+        if (s->has_pending.load(std::memory_order_acquire)) return true;
+    }
+    return false;
+}
+
+void ShardedBroadcaster::abort_client() {
+    Shard& s = *shards_[next_abort_shard_];
+    next_abort_shard_ = (next_abort_shard_ + 1) % shards_.size();
+    s.aborts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ShardedBroadcaster::publish(const void* data, size_t len) {
+    ring_.publish(data, len, [] { std::this_thread::yield(); });
+}
+
+// Start serving newly accepted sockets, snapshot first
+void ShardedBroadcaster::adopt_pending(Shard& s) {
+    if (!s.has_pending.load(std::memory_order_acquire)) return;
+    std::lock_guard<std::mutex> lock(s.pending_mtx);
+    for (auto& p : s.pending_fds) s.clients.add_client(p.first, p.second);
+    s.pending_fds.clear();
+    s.has_pending.store(false, std::memory_order_relaxed);
+}
+
+void ShardedBroadcaster::shard_loop(size_t id) {
+    Shard& s = *shards_[id];
+
+    while (running_.load(std::memory_order_acquire)) {
+        adopt_pending(s);
+
+        // Injected connection resets
+        if (s.aborts.load(std::memory_order_relaxed)) {
+            for (uint32_t n = s.aborts.exchange(0); n > 0; --n)
+                s.clients.abort_client(s.abort_pick++);
+        }
+
+        // EPOLLOUT draining and disconnects for this shard's clients
+        s.clients.handle_events(-1);
+
+        // Fan out everything the generator has published so far
+        bool idle = true;
+        size_t len;
+        while (const uint8_t* batch = ring_.peek(id, len)) {
+            // The generator hands a socket over before it publishes the
+            // batches its snapshot doesn't cover, so seeing this batch
+            // means seeing the socket: adopt it now, not after the pass.
+            // Older batches it also gets are dropped as stale.
+            adopt_pending(s);
+            s.clients.broadcast(batch, len);
+            ring_.advance(id);
+            idle = false;
+        }
+
+        if (idle) std::this_thread::yield();
+    }
+}
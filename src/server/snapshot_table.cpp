@@ -0,0 +1,122 @@
+// src/server/snapshot_table.cpp
+#include "exchange_simulator.h"
+#include "wire.h"
+#include <algorithm>
+#include <cstring>
+
+SnapshotTable::SnapshotTable(size_t num_symbols)
+    : state_(num_symbols),
+      locks_(new std::atomic<uint64_t>[num_symbols]) {
+    for (size_t i = 0; i < num_symbols; ++i) {
+        state_[i].type = MsgType::Snapshot;
+        state_[i].symbol_id = uint32_t(i);
+        locks_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void SnapshotTable::set_depth_levels(size_t levels) {
+    depth_ = levels;
+    levels_.assign(state_.size() * 2 * depth_, Level{0, 0});
+    counts_.assign(depth_ ? state_.size() * 2 : 0, 0);
+}
+
+void SnapshotTable::update(const Tick& tick) {
+    if (tick.symbol_id >= state_.size() || tick.type == MsgType::Heartbeat) return;
+    Tick& s = state_[tick.symbol_id];
+    std::atomic<uint64_t>& lock = locks_[tick.symbol_id];
+
+    // Seqlock write section (see RetransmitStore::record)
+    uint64_t seq = lock.load(std::memory_order_relaxed);
+    lock.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (tick.type == MsgType::Quote) {
+        s.bid_price = tick.bid_price;
+        s.bid_qty = tick.bid_qty;
+        s.ask_price = tick.ask_price;
+        s.ask_qty = tick.ask_qty;
+    } else if (tick.type == MsgType::Trade) {
+        s.last_trade_price = tick.last_trade_price;
+        s.trade_qty = tick.trade_qty;
+    } else if (tick.type == MsgType::DepthUpdate && depth_ && size_t(tick.depth_side) < 2) {
+        // Same level semantics as the client's DepthCache
+        uint8_t& count = counts_[size_t(tick.symbol_id) * 2 + size_t(tick.depth_side)];
+        Level* lv = side_levels(tick.symbol_id, tick.depth_side);
+        size_t level = tick.depth_level;
+
+        switch (tick.depth_action) {
+        case DepthAction::New:
+            if (level <= count && level < depth_) {
+                size_t keep = std::min<size_t>(count, depth_ - 1);
+                std::memmove(lv + level + 1, lv + level, (keep - level) * sizeof(Level));
+                lv[level] = Level{tick.depth_price, tick.depth_qty};
+                count = uint8_t(keep + 1);
+            }
+            break;
+        case DepthAction::Change:
+            if (level < count) lv[level] = Level{tick.depth_price, tick.depth_qty};
+            break;
+        case DepthAction::Delete:
+            if (level < count) {
+                std::memmove(lv + level, lv + level + 1,
+                             (count - level - 1) * sizeof(Level));
+                --count;
+            }
+            break;
+        }
+    }
+    // Any tick moves the seq: the image is consistent up to it
+    s.seq_no = tick.seq_no;
+    s.timestamp_ns = tick.timestamp_ns;
+
+    lock.store(seq + 2, std::memory_order_release);
+}
+
+size_t SnapshotTable::encode(std::vector<uint8_t>& out) const {
+    size_t symbols = 0;
+    out.reserve(out.size() + state_.size() *
+                (wire::SNAPSHOT_FRAME_SIZE + 2 * depth_ * wire::DEPTH_FRAME_SIZE));
+    for (size_t i = 0; i < state_.size(); ++i) {
+        if (encode_symbol(uint16_t(i), out)) ++symbols;
+    }
+    return symbols;
+}
+
+bool SnapshotTable::encode_symbol(uint16_t symbol, std::vector<uint8_t>& out) const {
+    if (symbol >= state_.size()) return false;
+    const std::atomic<uint64_t>& lock = locks_[symbol];
+    const size_t base = out.size();
+
+    // A symbol changes once per generator lap, so a retry is rare
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        out.resize(base);
+        uint64_t start = lock.load(std::memory_order_acquire);
+        if (start & 1) continue;
+
+        Tick s = state_[symbol];
+        if (s.seq_no == 0) return false;
+
+        // The image goes first: the client holds it until the Snapshot
+        // says it is current, then swaps it in whole
+        for (size_t side = 0; side < 2 && depth_; ++side) {
+            const Level* lv = side_levels(symbol, Side(side));
+            size_t count = std::min<size_t>(counts_[size_t(symbol) * 2 + side], depth_);
+            for (size_t i = 0; i < count; ++i) {
+                size_t at = out.size();
+                out.resize(at + wire::DEPTH_FRAME_SIZE);
+                wire::encode_depth(out.data() + at, uint32_t(s.seq_no), s.timestamp_ns,
+                                   symbol, Side(side), DepthAction::New,
+                                   uint8_t(i), lv[i].price, lv[i].qty,
+                                   MsgType::DepthImage);
+            }
+        }
+        size_t at = out.size();
+        out.resize(at + wire::SNAPSHOT_FRAME_SIZE);
+        wire::encode(s, out.data() + at);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (lock.load(std::memory_order_relaxed) == start) return true;
+    }
+    out.resize(base);
+    return false;
+}
@@ -1,63 +1,243 @@
+
 #include "exchange_simulator.h"
 #include <iostream>
 #include <cmath>
-#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+/* ---------------- Counter-based RNG ----------------
+ * Random values are a pure function of (key, step, symbol, lane), so the
+ * per-symbol loops carry no RNG state between iterations and vectorise.
+ */
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+constexpr float INV_2_24 = 1.0f / 16777216.0f;
+
+// (0, 1] and [0, 1) from the top 24 bits
+inline float uniform_open0(uint32_t h) { return float(int32_t(h >> 8) + 1) * INV_2_24; }
+inline float uniform(uint32_t h)       { return float(int32_t(h >> 8)) * INV_2_24; }
+
+/* ---------------- Branch-free float math ----------------
+ * libm calls block vectorisation, so Box-Muller uses these instead.
+ * fast_log: Cephes logf polynomial (abs error < 5e-7 on (0, 1]).
+ * sincos_turn: sin/cos of 2*pi*t, t in [0, 1), via quadrant + Taylor
+ * polynomials on [0, pi/2) (abs error < 3e-7).
+ */
+inline float fast_log(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, 4);
+    int e = int((bits >> 23) & 0xff) - 126;
+    bits = (bits & 0x007fffffU) | 0x3f000000U;   // mantissa in [0.5, 1)
+    float m;
+    std::memcpy(&m, &bits, 4);
+
+    // Below sqrt(0.5): use 2m - 1 and one less exponent (kept branch-free)
+    int small = m < 0.70710678f;
+    e -= small;
+    m = (m - 1.0f) + float(small) * m;
+
+    float z = m * m;
+    float y = 7.0376836292e-2f;
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+
+    float fe = float(e);
+    y += fe * -2.12194440e-4f;
+    y -= 0.5f * z;
+    return m + y + fe * 0.693359375f;
+}
+
+inline void sincos_turn(float t, float& s, float& c) {
+    float q = t * 4.0f;
+    int k = int(q);                               // quadrant 0..3
+    float a = (q - float(k)) * 1.57079632679f;    // [0, pi/2)
+    float a2 = a * a;
+
+    float sa = a * (1.0f + a2 * (-1.0f / 6 + a2 * (1.0f / 120 + a2 *
+               (-1.0f / 5040 + a2 * (1.0f / 362880 + a2 * (-1.0f / 39916800))))));
+    float ca = 1.0f + a2 * (-0.5f + a2 * (1.0f / 24 + a2 * (-1.0f / 720 + a2 *
+               (1.0f / 40320 + a2 * (-1.0f / 3628800 + a2 * (1.0f / 479001600))))));
+
+    // Rotate by k quarter turns (arithmetic selects keep it branch-free)
+    float odd = float(k & 1);
+    float sv = odd * ca + (1.0f - odd) * sa;
+    float cv = odd * sa + (1.0f - odd) * ca;
+    s = sv * float(1 - ((k >> 1) & 1) * 2);
+    c = cv * float(1 - (((k + 1) >> 1) & 1) * 2);
+}
+
+constexpr double DT = 0.001;
+constexpr float TRADE_RATIO = 0.30f;   // 70/30 quotes/trades
+constexpr float DEPTH_RATIO = 0.30f;   // of all ticks, taken from quotes when L2 is on
+constexpr size_t MAX_DEPTH_LEVELS = 20;
+
+enum TickKind : uint8_t { KIND_QUOTE = 0, KIND_TRADE = 1, KIND_DEPTH = 2 };
 
-TickGenerator::TickGenerator(size_t num_symbols)
-    : rng_(std::random_device{}())
+} // anonymous namespace
+
+TickGenerator::TickGenerator(size_t num_symbols, uint64_t seed)
+    : price_(num_symbols),
+      vol_(num_symbols),
+      drift_(num_symbols, 0.0),
+      spread_(num_symbols, 0.0),
+      seq_(num_symbols, 0),
+      bid_(num_symbols),
+      ask_(num_symbols),
+      kind_(num_symbols),
+      z_(num_symbols + 1),
+      key_lo_(hash32(uint32_t(seed) ^ 0x9e3779b9U)),
+      key_hi_(hash32(uint32_t(seed >> 32) ^ 0x85ebca6bU))
 {
-    std::uniform_real_distribution<double> price_dist(100, 5000);
-    std::uniform_real_distribution<double> vol_dist(0.01, 0.06);
-
-    for (uint16_t i = 0; i < num_symbols; ++i) {
-        symbols_[i] = {
-            price_dist(rng_),
-            vol_dist(rng_),
-            0.0,     // drift
-            0.0,     // spread
-            0        // seq
-        };
+    // Initial prices 100-5000, volatility 0.01-0.06
+    uint32_t init_key = hash32(key_lo_ ^ key_hi_);
+    for (size_t i = 0; i < num_symbols; ++i) {
+        uint32_t k = uint32_t(i) * 2;
+        price_[i] = 100.0 + 4900.0 * uniform(hash32(k ^ init_key));
+        vol_[i]   = 0.01 + 0.05 * uniform(hash32((k + 1) ^ init_key));
     }
 }
 
-bool TickGenerator::generate(uint16_t symbol_id, Tick& tick) {
-    auto& s = symbols_[symbol_id];
+void TickGenerator::step() {
+    const size_t n = price_.size();
+    const size_t half = (n + 1) / 2;
+
+    uint32_t sk = hash32(hash32(uint32_t(step_) ^ key_lo_) ^
+                         uint32_t(step_ >> 32) ^ key_hi_);
+    ++step_;
 
-    double dt = 0.001;
-    std::normal_distribution<double> normal(0.0, 1.0);
-    double dW = normal(rng_) * std::sqrt(dt);
+    // 1) Box-Muller: each pair index yields two normals (z_[j], z_[j+half])
+    float* z = z_.data();
+    for (size_t j = 0; j < half; ++j) {
+        uint32_t base = uint32_t(j) * 4;
+        float u1 = uniform_open0(hash32(base ^ sk));
+        float u2 = uniform(hash32((base + 1) ^ sk));
+        float r = std::sqrt(-2.0f * fast_log(u1));
+        float s, c;
+        sincos_turn(u2, s, c);
+        z[j] = r * c;
+        z[j + half] = r * s;
+    }
 
-    // GBM
-    s.price += s.drift * s.price * dt + s.volatility * s.price * dW;
+    // 2) GBM step, spread, and trade/quote pick for every symbol
+    const double sqrt_dt = std::sqrt(DT);
+    double* price = price_.data();
+    double* spread = spread_.data();
+    double* bid = bid_.data();
+    double* ask = ask_.data();
+    uint8_t* kind = kind_.data();
+    const float depth_cut = TRADE_RATIO + (depth_levels_ ? DEPTH_RATIO : 0.0f);
+    const double* vol = vol_.data();
+    const double* drift = drift_.data();
 
-    // Spread
-    s.spread = s.price * (0.0005 + ((double)rand() / RAND_MAX) * 0.0015);
-    double bid = s.price - s.spread / 2;
-    double ask = s.price + s.spread / 2;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t base = uint32_t(i) * 4;
+        float u_spread = uniform(hash32((base + 2) ^ sk));
+        float u_side   = uniform(hash32((base + 3) ^ sk));
 
+        double p = price[i];
+        p += drift[i] * p * DT + vol[i] * p * sqrt_dt * double(z[i]);
+        price[i] = p;
+
+        double sp = p * (0.0005 + double(u_spread) * 0.0015);
+        spread[i] = sp;
+        bid[i] = p - sp * 0.5;
+        ask[i] = p + sp * 0.5;
+        kind[i] = uint8_t(u_side < TRADE_RATIO) |
+                  uint8_t(uint8_t(u_side >= TRADE_RATIO && u_side < depth_cut) << 1);
+    }
+}
+
+void TickGenerator::emit(uint16_t symbol_id, uint64_t ts_ns, Tick& tick) {
     // Metadata
-    tick.timestamp_ns =
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-            std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    tick.timestamp_ns = ts_ns;
     tick.symbol_id = symbol_id;
-    tick.seq_no = ++s.seq_no;
+    tick.seq_no = ++seq_[symbol_id];
     if (symbol_id == 0 && tick.seq_no % 10000 == 0) {
         std::cout << "Generated tick seq=" << tick.seq_no << "\n";
     }
 
-    // 70/30
-    if ((rand() % 100) < 30) {
-        tick.last_trade_price = s.price;
+    if (kind_[symbol_id] == KIND_DEPTH) {
+        emit_depth(symbol_id, tick);
+    } else if (kind_[symbol_id] == KIND_TRADE) {
+        tick.type = MsgType::Trade;
+        tick.last_trade_price = price_[symbol_id];
         tick.trade_qty = 50;
         tick.bid_price = tick.ask_price = 0;
         tick.bid_qty = tick.ask_qty = 0;
     } else {
-        tick.bid_price = bid;
-        tick.ask_price = ask;
+        tick.type = MsgType::Quote;
+        tick.bid_price = bid_[symbol_id];
+        tick.ask_price = ask_[symbol_id];
         tick.bid_qty = tick.ask_qty = 100;
         tick.trade_qty = 0;
-        tick.last_trade_price = s.price;
+        tick.last_trade_price = price_[symbol_id];
     }
+}
+
+void TickGenerator::set_depth_levels(size_t levels) {
+    depth_levels_ = std::min(levels, MAX_DEPTH_LEVELS);
+    depth_count_.assign(depth_levels_ ? 2 * price_.size() : 0, 0);
+}
+
+// One level operation on the symbol's generated book. The book fills up
+// with New at a random level, then mostly sees Change with the odd Delete,
+// so the level count each client tracks always matches this one. Prices
+// sit on a ladder of half-spread steps away from the current bid/ask.
+void TickGenerator::emit_depth(uint16_t symbol_id, Tick& tick) {
+    uint32_t h = hash32(uint32_t(tick.seq_no) ^
+                        hash32(uint32_t(symbol_id) ^ key_lo_) ^ key_hi_);
+    Side side = Side(h & 1);
+    uint8_t& count = depth_count_[size_t(symbol_id) * 2 + size_t(side)];
+    uint32_t r = h >> 8;
+
+    DepthAction action;
+    uint8_t level;
+    if (count < depth_levels_) {
+        action = DepthAction::New;
+        level = uint8_t(r % (count + 1u));
+        ++count;
+    } else if (((h >> 1) & 7) == 0) {
+        action = DepthAction::Delete;
+        level = uint8_t(r % count);
+        --count;
+    } else {
+        action = DepthAction::Change;
+        level = uint8_t(r % count);
+    }
+
+    double step = spread_[symbol_id] * 0.5;
+    tick.type = MsgType::DepthUpdate;
+    tick.depth_side = side;
+    tick.depth_action = action;
+    tick.depth_level = level;
+    tick.depth_price = side == Side::Bid ? bid_[symbol_id] - step * level
+                                         : ask_[symbol_id] + step * level;
+    tick.depth_qty = 100 * (1 + ((h >> 4) & 15));
+    tick.bid_price = tick.ask_price = tick.last_trade_price = 0;
+    tick.bid_qty = tick.ask_qty = tick.trade_qty = 0;
+}
+
+size_t TickGenerator::generate_all(Tick* out, uint64_t ts_ns) {
+    step();
 
-    return true;
+    const size_t n = size();
+    for (size_t i = 0; i < n; ++i)
+        emit(static_cast<uint16_t>(i), ts_ns, out[i]);
+    return n;
 }